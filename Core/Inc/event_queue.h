@@ -0,0 +1,40 @@
+/*
+ * event_queue.h
+ *
+ *  Events from the interrupts to the main loop. The ISRs only push an event id, the main loop pops
+ *  them and runs the drivers, so no bus transfer and no HAL_GetTick wait runs in interrupt context.
+ *
+ *  Lock free single producer, single consumer ring: head is written by the producer only, tail by
+ *  the consumer only. Every producer must run at the same preemption priority so they never preempt
+ *  each other (TIM2, the RTC alarm and the ALERT EXTI, all 0); the SysTick at 15 must not push.
+ *  The jobs of the timer wheel (timer_wheel.h) hand out the same ids, without going through the ring.
+ */
+
+#ifndef EVENT_QUEUE_H_
+#define EVENT_QUEUE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define EVENT_QUEUE_SIZE             8             // Power of two, one slot stays empty
+
+typedef enum{
+    EVT_WHEEL_TICK = 0,                            // TIM2 every second or the RTC alarm: advance the timer wheel
+    EVT_SAMPLE_DUE,                                // Sampling job: start the conversions of a log record
+    EVT_FLUSH_CHECK,                               // Flush job: check the EEPROM flush policy, retry a failed page write
+    EVT_HEALTH_CHECK,                              // Health job: set up the sensors that gave no result again
+    EVT_ALERT                                      // ALERT EXTI or the ALERT check job: a sensor may have crossed a band edge
+}EVENT_ID;
+
+typedef struct{
+    volatile uint8_t head;                         // Next slot to push, producer only
+    volatile uint8_t tail;                         // Next slot to pop, consumer only
+    volatile uint8_t lost;                         // Events dropped on a full queue, producer only
+    volatile EVENT_ID events[EVENT_QUEUE_SIZE];
+}EVENT_Queue;
+
+bool EVENT_Push(EVENT_Queue *queue, EVENT_ID event);
+bool EVENT_Pop(EVENT_Queue *queue, EVENT_ID *event);
+bool EVENT_Pending(EVENT_Queue *queue);
+
+#endif /* EVENT_QUEUE_H_ */
@@ -0,0 +1,35 @@
+/*
+ * idle.h
+ *
+ *  Tickless idle of the main loop: the SysTick reload is stretched over the time the tick handlers have
+ *  nothing to do, so the core sleeps through it in one WFI instead of waking every millisecond. Any other
+ *  interrupt ends the sleep early; the HAL tick is advanced by the whole milliseconds slept and the SysTick
+ *  restarted on the phase of the old millisecond grid, so HAL_GetTick based timeouts stay exact.
+ *
+ *  The time spent in SLEEP and STOP is counted for the duty cycle statistics.
+ */
+
+#ifndef IDLE_H_
+#define IDLE_H_
+
+#include "stm32f1xx_hal.h"
+#include <stdint.h>
+
+#define IDLE_MIN_TICKLESS_MS         2             // Shorter sleeps keep the SysTick running, a plain WFI
+
+typedef struct{
+    uint32_t window_start;                         // HAL tick of the last IDLE_ResetStats
+    uint32_t sleep_ms;                             // In SLEEP (WFI), with the SysTick running or stretched
+    uint32_t stop_ms;                              // In STOP, see WAKEUP_EnterStop
+    uint32_t sleeps;                               // WFI entered
+    uint32_t stops;                                // STOP entered
+    uint32_t ticks_skipped;                        // SysTick interrupts saved by the tickless sleeps
+}IDLE_Stats;
+
+void IDLE_Sleep(uint32_t max_ms);
+void IDLE_CountStop(uint32_t ms);
+void IDLE_GetStats(IDLE_Stats *stats);
+void IDLE_ResetStats(void);
+uint16_t IDLE_DutyPermille(void);
+
+#endif /* IDLE_H_ */
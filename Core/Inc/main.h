@@ -59,7 +59,41 @@ void Error_Handler(void);
 /* Private defines -----------------------------------------------------------*/
 
 /* USER CODE BEGIN Private defines */
-
+// ALERT output of a TMP101 on an EXTI line: the sensor converts continuously as a thermostat and
+// a sample is only logged when the temperature leaves the band. The TMP100 has no ALERT pin.
+//#define TMP_ALERT_Pin             GPIO_PIN_5
+//#define TMP_ALERT_GPIO_Port       GPIOB
+//#define TMP_ALERT_EXTI_IRQn       EXTI9_5_IRQn
+//#define TMP_ALERT_IRQHandler      EXTI9_5_IRQHandler
+#define LOG_INTERVAL_S              600     // Seconds between log records
+#define LOG_FLUSH_AGE_S             3600    // Staged records reach the EEPROM at most this late, all a reset can lose
+#define LOG_HEALTH_INTERVAL_S       3600    // Seconds between set up attempts of the sensors that gave no result
+// RTC alarm wakes the MCU from STOP at every log deadline instead of 600 TIM2 interrupts per record;
+// comment out to keep the TIM2 second tick and sleep mode. LSE crystal if fitted, else the LSI.
+#define LOG_RTC_WAKEUP
+#define LOG_RESOLUTION              TMP_RES_12BIT   // TMP100: TMP_RES_9BIT (0.5 °C) converts 8x faster
+#define LOG_CAL_RUNS                4       // TMP102: conversions timed at boot, 0 keeps the datasheet times (always kept on the TMP100/TMP101)
+#define LOG_AVERAGING               TMP117_AVG_8    // TMP117: conversions averaged per one-shot
+#define LOG_BURST                   1       // Conversions per logged value, e.g. 8 at TMP_RES_9BIT take as long as one at 12 bit
+#define LOG_FILTER                  TMP_FILTER_MEDIAN   // or TMP_FILTER_TRIMMED_MEAN, only the filtered value is logged
+#define LOG_BAND_LOW_CENTI          200     // Cold chain band in 0.01 °C
+#define LOG_BAND_HIGH_CENTI         800
+#define LOG_BAND_HYST_CENTI         50      // ALERT: back in the band this far inside the crossed edge
+#define LOG_ALERT_CHECK_S           300     // ALERT: sensors re-read and the watched band edge picked again
+// Commissioning and troubleshooting: the sensors convert continuously and are read every
+// LOG_MONITOR_PERIOD_MS, only the mean of LOG_MONITOR_DECIM reads is logged (10 s records,
+// about 45 h of one sensor in the 24FC256). A TMP100 needs TMP_RES_10BIT or less for 4 reads/s.
+//#define LOG_MONITOR_PERIOD_MS       250
+#define LOG_MONITOR_DECIM           40      // Reads per logged record
+// Adaptive sampling: the interval halves down to LOG_ADAPT_MIN_S while a sensor changes faster than
+// LOG_ADAPT_FAST_CPM and doubles back up to LOG_INTERVAL_S while all change slower than LOG_ADAPT_SLOW_CPM
+// (0.01 °C per minute). Every record then starts with its interval in seconds, 2 bytes.
+//#define LOG_ADAPTIVE
+#define LOG_ADAPT_MIN_S             30      // Fastest sampling, door openings and defrost cycles
+#define LOG_ADAPT_FAST_CPM          20      // 0.2 °C/min speeds the sampling up
+#define LOG_ADAPT_SLOW_CPM          5       // Below 0.05 °C/min it backs off
+// Prints the awake share of the core and the sleep counters with every record, see idle.h
+//#define LOG_IDLE_STATS
 /* USER CODE END Private defines */
 
 #ifdef __cplusplus
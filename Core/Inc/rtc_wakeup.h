@@ -0,0 +1,33 @@
+/*
+ * rtc_wakeup.h
+ *
+ *  RTC alarm scheduler: the RTC counts seconds on the LSE (the LSI if no crystal starts) and its alarm
+ *  wakes the MCU from STOP at the next logging deadline. The HAL tick is advanced by the time spent in
+ *  STOP, so HAL_GetTick based ages and timeouts carry on as if the SysTick had kept running.
+ *
+ *  Register level, the HAL RTC driver is not part of this project. The alarm interrupt
+ *  (RTC_Alarm_IRQn, EXTI line 17) runs at preemption priority 0 like TIM2, so it may push events.
+ */
+
+#ifndef RTC_WAKEUP_H_
+#define RTC_WAKEUP_H_
+
+#include "stm32f1xx_hal.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define WAKEUP_LSE_PRESCALER         32767         // 32.768 kHz crystal to 1 Hz
+#define WAKEUP_LSI_PRESCALER         39999         // About 40 kHz RC, ±50 % over temperature on the F103
+#define WAKEUP_LSE_TIMEOUT_MS        5000          // Crystal start up, falls back to the LSI after it
+#define WAKEUP_SYNC_TIMEOUT_MS       10            // LSI start, register synchronisation, write completion
+#define WAKEUP_EXTI_LINE             EXTI_IMR_MR17 // RTC alarm
+
+HAL_StatusTypeDef WAKEUP_Init(void);
+bool WAKEUP_OnLSE(void);
+uint32_t WAKEUP_Seconds(void);
+HAL_StatusTypeDef WAKEUP_SetAlarm(uint32_t second);
+uint32_t WAKEUP_EnterStop(void);
+void WAKEUP_IRQHandler(void);
+void WAKEUP_AlarmCallback(void);
+
+#endif /* RTC_WAKEUP_H_ */
@@ -0,0 +1,52 @@
+/*
+ * timer_wheel.h
+ *
+ *  Hierarchical timer wheel on a one second base for the jobs of the logger (sampling, EEPROM flush,
+ *  sensor health checks). Three levels of 32 slots span 32 s, 17 min and 9 h: a timer is filed by its
+ *  expiry and moved a level down when the wheel reaches its slot, so arming, stopping and every second
+ *  of advance cost O(1) whatever the number of timers. Timers beyond 9 h wait in the top level.
+ *
+ *  The timers belong to the caller and fire by handing out their event id. The wheel is only used from
+ *  the main loop; the interrupts just queue EVT_WHEEL_TICK to wake it.
+ */
+
+#ifndef TIMER_WHEEL_H_
+#define TIMER_WHEEL_H_
+
+#include "stm32f1xx_hal.h"
+#include "event_queue.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define WHEEL_LEVELS                 3
+#define WHEEL_SLOT_BITS              5             // 32 slots, one bit each in the occupied mask
+#define WHEEL_SLOTS                  (1U << WHEEL_SLOT_BITS)
+#define WHEEL_SLOT_MASK              (WHEEL_SLOTS - 1U)
+#define WHEEL_SPAN                   (1UL << (WHEEL_SLOT_BITS * WHEEL_LEVELS))  // Seconds filed exactly
+
+typedef struct WHEEL_Timer{
+    struct WHEEL_Timer *next;
+    struct WHEEL_Timer *prev;
+    uint32_t expiry;                               // Wheel second it fires at
+    uint32_t period;                               // Seconds between runs, 0 for a one-shot
+    EVENT_ID event;                                // Handed out by WHEEL_Expired
+    uint8_t level;                                 // Slot list the timer is on, WHEEL_LEVELS for the expired list
+    uint8_t slot;
+    bool armed;
+}WHEEL_Timer;
+
+typedef struct{
+    uint32_t now;                                  // Second the wheel has been advanced to
+    uint32_t occupied[WHEEL_LEVELS];               // Bit per slot with timers
+    WHEEL_Timer *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    WHEEL_Timer *expired;                          // Fired, not handed out yet
+}WHEEL_Handle;
+
+void WHEEL_Init(WHEEL_Handle *wheel, uint32_t now);
+void WHEEL_Start(WHEEL_Handle *wheel, WHEEL_Timer *timer, uint32_t delay, uint32_t period, EVENT_ID event);
+void WHEEL_Stop(WHEEL_Handle *wheel, WHEEL_Timer *timer);
+void WHEEL_Advance(WHEEL_Handle *wheel, uint32_t now);
+bool WHEEL_Expired(WHEEL_Handle *wheel, EVENT_ID *event);
+bool WHEEL_NextDeadline(WHEEL_Handle *wheel, uint32_t *second);
+
+#endif /* TIMER_WHEEL_H_ */
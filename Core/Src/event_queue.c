@@ -0,0 +1,57 @@
+/*
+ * event_queue.c
+ *
+ *  Single producer, single consumer event ring between the interrupts and the main loop
+ */
+#include "event_queue.h"
+
+/*
+ * @brief Queues an event, from the producing interrupt. A few instructions, no lock and no wait.
+ * @param[1] queue pointer
+ * @param[2] event to queue
+ * @retval false if the queue was full, the event is dropped and counted in lost
+ *
+ * */
+bool EVENT_Push(EVENT_Queue *queue, EVENT_ID event)
+{
+    uint8_t head = queue->head;
+    uint8_t next = (uint8_t)((head + 1) & (EVENT_QUEUE_SIZE - 1));
+    if (next == queue->tail)
+    {
+        queue->lost++;
+        return false;
+    }
+
+    queue->events[head] = event;
+    queue->head = next;  // last, publishes the event to the main loop
+    return true;
+}
+
+/*
+ * @brief Takes the oldest event, from the main loop
+ * @param[1] queue pointer
+ * @param[2] event used to return the event
+ * @retval false if the queue is empty
+ *
+ * */
+bool EVENT_Pop(EVENT_Queue *queue, EVENT_ID *event)
+{
+    uint8_t tail = queue->tail;
+    if (tail == queue->head)
+        return false;
+
+    *event = queue->events[tail];
+    queue->tail = (uint8_t)((tail + 1) & (EVENT_QUEUE_SIZE - 1));  // last, frees the slot for the producer
+    return true;
+}
+
+/*
+ * @brief Whether an event is waiting, for the check before sleeping with the interrupts disabled
+ * @param queue pointer
+ * @retval true if EVENT_Pop would return an event
+ *
+ * */
+bool EVENT_Pending(EVENT_Queue *queue)
+{
+    return (queue->tail != queue->head);
+}
@@ -0,0 +1,169 @@
+/*
+ * idle.c
+ *
+ *  Tickless idle and duty cycle statistics, see idle.h
+ */
+#include "idle.h"
+#include "string.h"
+
+static IDLE_Stats idle_stats;
+static uint32_t idle_cycles;  // SLEEP time below one ms, carried over to the next sleep
+
+/*Static function declaration
+ * */
+static void IDLE_CountSleep(uint32_t cycles, uint32_t per_ms);
+
+/*
+ * @brief Sleeps until an interrupt, at most max_ms. Call it with the interrupts disabled after checking
+ *        there is nothing to do, the wake up interrupt is taken once they are enabled again. From
+ *        IDLE_MIN_TICKLESS_MS on the SysTick only fires at the end of max_ms, so max_ms must be the time
+ *        until the next tick handler work; the sleep is capped to the 24 bit SysTick (about 2 s at 8 MHz).
+ * @param max_ms until a tick handler needs the SysTick, UINT32_MAX if none does
+ * @retval void
+ *
+ * */
+void IDLE_Sleep(uint32_t max_ms)
+{
+    uint32_t per_ms = SysTick->LOAD + 1U;  // core clocks per tick, as set by HAL_InitTick
+    uint32_t limit = SysTick_LOAD_RELOAD_Msk / per_ms;
+    if (max_ms > limit)
+        max_ms = limit;
+
+    if (max_ms < IDLE_MIN_TICKLESS_MS)
+    {
+        (void)SysTick->CTRL;  // clears COUNTFLAG
+        uint32_t before = SysTick->VAL;
+        if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk)
+            return;  // a tick is due, taken once the interrupts are enabled
+
+        idle_stats.sleeps++;
+        __DSB();
+        __WFI();
+        __ISB();
+        uint32_t after = SysTick->VAL;
+        if (SysTick->CTRL & SysTick_CTRL_COUNTFLAG_Msk)
+            IDLE_CountSleep(before + per_ms - after, per_ms);  // woken by the tick
+        else
+            IDLE_CountSleep(before - after, per_ms);
+        return;
+    }
+
+    SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+    if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk)
+    {
+        SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+        return;
+    }
+
+    // one reload over the whole idle time, from the current phase of the millisecond
+    uint32_t reload = SysTick->VAL + (max_ms - 1U) * per_ms;
+    SysTick->LOAD = reload;
+    SysTick->VAL = 0;
+    SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+    idle_stats.sleeps++;
+    __DSB();
+    __WFI();
+    __ISB();
+
+    uint32_t ctrl = SysTick->CTRL;  // read once, reading clears COUNTFLAG
+    SysTick->CTRL = ctrl & ~SysTick_CTRL_ENABLE_Msk;
+    uint32_t left = SysTick->VAL;
+    uint32_t passed;  // tick boundaries slept through
+    uint32_t next;    // clocks to the next boundary of the old grid
+    if (ctrl & SysTick_CTRL_COUNTFLAG_Msk)
+    {
+        // slept the whole time, the pending SysTick adds the last ms
+        uint32_t late = reload - left;
+        passed = max_ms - 1U;
+        next = (late < per_ms - 1U) ? per_ms - late : per_ms;
+        IDLE_CountSleep(reload + 1U + late, per_ms);
+    }
+    else
+    {
+        // another interrupt, only the boundaries behind us count
+        if (left == 0)
+            left = 1;
+        passed = max_ms - (left + per_ms - 1U) / per_ms;
+        next = ((left - 1U) % per_ms) + 1U;
+        if (next < 2U)
+        {
+            passed++;  // too close to restart on, counted here
+            next += per_ms;
+        }
+        IDLE_CountSleep(reload - left, per_ms);
+    }
+
+    SysTick->LOAD = next - 1U;
+    SysTick->VAL = 0;
+    SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+    SysTick->LOAD = per_ms - 1U;  // taken at the next reload
+    uwTick += passed;
+    idle_stats.ticks_skipped += passed;
+}
+
+/*
+ * @brief Adds a STOP period to the statistics, STOP is entered by WAKEUP_EnterStop
+ * @param ms spent in STOP
+ * @retval void
+ *
+ * */
+void IDLE_CountStop(uint32_t ms)
+{
+    idle_stats.stop_ms += ms;
+    idle_stats.stops++;
+}
+
+/*
+ * @brief Copies the statistics since the last IDLE_ResetStats, or since the boot
+ * @param stats used to return the counters
+ * @retval void
+ *
+ * */
+void IDLE_GetStats(IDLE_Stats *stats)
+{
+    *stats = idle_stats;
+}
+
+/*
+ * @brief Clears the statistics and starts a new window at the current HAL tick
+ * @param none
+ * @retval void
+ *
+ * */
+void IDLE_ResetStats(void)
+{
+    memset(&idle_stats, 0, sizeof(idle_stats));
+    idle_cycles = 0;
+    idle_stats.window_start = HAL_GetTick();
+}
+
+/*
+ * @brief Share of the window the core was awake
+ * @param none
+ * @retval 0 to 1000 ‰, 1000 for an empty window
+ *
+ * */
+uint16_t IDLE_DutyPermille(void)
+{
+    uint32_t window = HAL_GetTick() - idle_stats.window_start;
+    uint32_t asleep = idle_stats.sleep_ms + idle_stats.stop_ms;
+    if (window == 0)
+        return 1000;
+    if (asleep >= window)
+        return 0;
+    return (uint16_t)(((uint64_t)(window - asleep) * 1000U) / window);
+}
+
+/*
+ * @brief Static function to add SLEEP time measured in core clocks
+ * @param[1] clocks slept
+ * @param[2] clocks per ms
+ * @retval void
+ *
+ * */
+static void IDLE_CountSleep(uint32_t cycles, uint32_t per_ms)
+{
+    idle_cycles += cycles;
+    idle_stats.sleep_ms += idle_cycles / per_ms;
+    idle_cycles %= per_ms;
+}
@@ -25,7 +25,11 @@
 #include <stdio.h>
 #include "string.h"
 #include "24fc256.h"
-#include "tmp100.h"
+#include "temp_sensor.h"
+#include "event_queue.h"
+#include "rtc_wakeup.h"
+#include "idle.h"
+#include "timer_wheel.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -35,6 +39,26 @@
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
+#if defined(TMP_ALERT_Pin) && (TEMP_SENSOR != TEMP_SENSOR_TMP100) && (TEMP_SENSOR != TEMP_SENSOR_TMP102)
+#error "The ALERT wake up needs the thermostat of the TMP100 driver, a TMP101 or TMP102"
+#endif
+#if defined(TMP_ALERT_Pin) && defined(LOG_MONITOR_PERIOD_MS)
+#error "The ALERT wake up and the monitoring mode exclude each other"
+#endif
+#if !defined(TMP_ALERT_Pin) && !defined(LOG_MONITOR_PERIOD_MS)
+#define LOG_PERIODIC  // a record every LOG_INTERVAL_S, otherwise on ALERT or out of the monitoring reads
+#endif
+#if defined(LOG_MONITOR_PERIOD_MS) && defined(LOG_RTC_WAKEUP)
+#undef LOG_RTC_WAKEUP  // the monitoring reads are timed by the SysTick, no STOP
+#endif
+#if defined(LOG_ADAPTIVE) && !defined(LOG_PERIODIC)
+#error "Adaptive sampling changes the LOG_INTERVAL_S records, not the ALERT or monitoring ones"
+#endif
+#ifdef LOG_ADAPTIVE
+#define LOG_RECORD_HDR  2  // interval in seconds ahead of the temperatures
+#else
+#define LOG_RECORD_HDR  0
+#endif
 
 /* USER CODE END PD */
 
@@ -46,26 +70,435 @@
 /* Private variables ---------------------------------------------------------*/
 I2C_HandleTypeDef hi2c1;
 I2C_HandleTypeDef hi2c2;
+DMA_HandleTypeDef hdma_i2c1_rx;
 
 TIM_HandleTypeDef htim2;
 
 /* USER CODE BEGIN PV */
-uint16_t second_counter = 0;
+volatile uint32_t uptime_s = 0;  // TIM2 seconds, the time base of the wheel without the RTC
 EEPROM_Handle eeprom_handle;
+// Channels of a log record in order, up to 8 sensors per bus (4 for TMP102/TMP117). A sensor on I2C1 only
+// gets the bus between EEPROM page writes, a trigger that finds it busy logs the channel as invalid.
+static const struct {
+  I2C_HandleTypeDef *hi2c;
+  uint16_t addr;
+} sensor_map[] = {
+  { &hi2c2, TEMP_I2C_ADDR_N(0) },
+//{ &hi2c2, TEMP_I2C_ADDR_N(1) },
+//{ &hi2c1, TEMP_I2C_ADDR_N(3) },
+};
+#define LOG_SENSOR_COUNT  (sizeof(sensor_map) / sizeof(sensor_map[0]))
+TEMP_Channel temp_channels[LOG_SENSOR_COUNT];
+TEMP_Array temp_array = { .channels = temp_channels, .count = LOG_SENSOR_COUNT };
+EVENT_Queue event_queue;  // TIM2, the RTC alarm and the ALERT EXTI push, the main loop runs the drivers
+WHEEL_Handle wheel;  // periodic jobs of the main loop, on the RTC or uptime seconds
+#ifdef LOG_PERIODIC
+static WHEEL_Timer sample_timer;
+#endif
+static WHEEL_Timer flush_timer;
+static WHEEL_Timer health_timer;
+static uint16_t sensor_faults = 0;  // bit per channel without a result in the last record
+static uint16_t records_lost = 0;  // records the EEPROM did not take
+#ifdef TMP_ALERT_Pin
+static WHEEL_Timer alert_timer;
+static int8_t alert_zone[LOG_SENSOR_COUNT];  // -1 below the band, 0 inside, 1 above
+static int16_t alert_threshold[LOG_SENSOR_COUNT];  // band edge the ALERT of the sensor watches
+#endif
+#ifdef LOG_ADAPTIVE
+static uint16_t sample_interval = LOG_INTERVAL_S;  // seconds, LOG_ADAPT_MIN_S to LOG_INTERVAL_S
+static uint32_t sample_second;  // wheel second the running sample was started at
+static int16_t last_temps[LOG_SENSOR_COUNT];  // previous record, for the rate of change
+static bool have_last = false;
+#endif
+#ifdef LOG_RTC_WAKEUP
+static bool rtc_wakeup = false;  // RTC running, the MCU stops between records and TIM2 stays off
+static uint32_t alarm_second = UINT32_MAX;  // RTC second the alarm is set to
+#endif
 /* USER CODE END PV */
 
 /* Private function prototypes -----------------------------------------------*/
 void SystemClock_Config(void);
 static void MX_GPIO_Init(void);
+static void MX_DMA_Init(void);
 static void MX_I2C1_Init(void); //EEPROM
 static void MX_I2C2_Init(void); //TMP100
 static void MX_TIM2_Init(void);
 /* USER CODE BEGIN PFP */
+static void LogRecord(const int16_t *temps);
+static void DispatchEvent(EVENT_ID event);
+static void SleepUntilEvent(void);
+static bool SetupSensor(uint8_t channel, bool calibrate);
+static uint32_t LogSeconds(void);
+static void ScheduleFlush(void);
+#ifdef TMP_ALERT_Pin
+static bool TrackAlert(uint8_t channel, int16_t centi);
+#endif
+#ifdef LOG_ADAPTIVE
+static void AdaptInterval(const int16_t *temps);
+#endif
+#ifdef LOG_RTC_WAKEUP
+static bool ArmWakeup(bool *alarm_set);
+#endif
 
 /* USER CODE END PFP */
 
 /* Private user code ---------------------------------------------------------*/
 /* USER CODE BEGIN 0 */
+/*
+ * @brief Stages one record for the EEPROM, a 2-byte signed integer per sensor in sensor_map order,
+ *        with LOG_ADAPTIVE behind the 2-byte interval in seconds since the record before
+ * @param temperatures in 0.01 °C, TEMP_CENTI_INVALID (0x8000) for a sensor that gave no result
+ * @retval void
+ *
+ * */
+static void LogRecord(const int16_t *temps)
+{
+  uint8_t data[LOG_RECORD_HDR + 2 * LOG_SENSOR_COUNT];
+#ifdef LOG_ADAPTIVE
+  data[0] = (uint8_t)(sample_interval >> 8);
+  data[1] = (uint8_t)(sample_interval & 0xFF);
+#endif
+  sensor_faults = 0;
+  for (uint8_t i = 0; i < LOG_SENSOR_COUNT; i++)
+  {
+    data[LOG_RECORD_HDR + 2 * i] = (uint8_t)(temps[i] >> 8);
+    data[LOG_RECORD_HDR + 2 * i + 1] = (uint8_t)(temps[i] & 0xFF);
+    if (temps[i] == TEMP_CENTI_INVALID)
+      sensor_faults |= (uint16_t)(1u << i);
+  }
+  // one call, the record is never split by a flush
+  HAL_StatusTypeDef ret = EEPROM_WriteBytes(&hi2c1,  &eeprom_handle, data, sizeof(data));
+  if (ret == HAL_BUSY)
+  {
+    // nothing staged: the next block waits for the page write in flight on its chip, or a failed one was resent
+    EEPROM_WaitWriteComplete(&eeprom_handle, EEPROM_ACK_TIMEOUT_MS);
+    ret = EEPROM_WriteBytes(&hi2c1,  &eeprom_handle, data, sizeof(data));
+  }
+  if (ret != HAL_OK)
+  {
+    records_lost++;
+    printf("EEPROM write failed, %u records lost!\r\n", records_lost);
+  }
+  ScheduleFlush();
+}
+
+/*
+ * @brief Runs the work of an interrupt event, from the main loop where the bus waits and their timeouts work
+ * @param event popped from event_queue
+ * @retval void
+ *
+ * */
+static void DispatchEvent(EVENT_ID event)
+{
+  switch (event)
+  {
+    case EVT_WHEEL_TICK:
+      break;  // only wakes the main loop, which advances the wheel on every pass
+
+    case EVT_SAMPLE_DUE:
+#ifdef LOG_ADAPTIVE
+      sample_second = wheel.now;
+#endif
+      // one config write per sensor, the results are fetched after one conversion time
+      if (TEMP_ArrayStart(&temp_array) != TMP_READY)
+        printf("Sensor I2C Read Failed!\r\n");
+      break;
+
+    case EVT_FLUSH_CHECK:
+      // time based flush policy, no bus traffic unless due
+      if (EEPROM_FlushIfDue(&hi2c1, &eeprom_handle) != HAL_OK)
+        WHEEL_Start(&wheel, &flush_timer, 1, 0, EVT_FLUSH_CHECK);  // page write in flight or failed, again in 1 s
+      else
+        ScheduleFlush();
+      break;
+
+    case EVT_HEALTH_CHECK:
+      // a sensor that came back (loose connector, brown out) is configured again, not while one converts
+      if ((temp_array.period == 0) && (temp_array.conv_state == TMP_CONV_IDLE) && (temp_array.burst_idx == 0))
+      {
+        for (uint8_t i = 0; i < LOG_SENSOR_COUNT; i++)
+        {
+          if ((sensor_faults & (1u << i)) && SetupSensor(i, false))
+            sensor_faults &= (uint16_t)~(1u << i);
+        }
+      }
+      break;
+
+#ifdef TMP_ALERT_Pin
+    case EVT_ALERT:
+    {
+      // the ALERT line or the LOG_ALERT_CHECK_S job; reading the temperature also clears the interrupt
+      // mode ALERT. A record is only logged when a sensor leaves or re-enters the band, or stops answering.
+      int16_t temps[LOG_SENSOR_COUNT];
+      bool changed = false;
+      for (uint8_t i = 0; i < LOG_SENSOR_COUNT; i++)
+      {
+        if (TEMP_ReadTemperature(sensor_map[i].hi2c, &temp_channels[i].sensor, &temps[i]) != TMP_READY)
+        {
+          temps[i] = TEMP_CENTI_INVALID;
+          printf("Sensor I2C Read Failed!\r\n");
+          changed |= !(sensor_faults & (1u << i));
+        }
+        else
+        {
+          changed |= TrackAlert(i, temps[i]);
+        }
+      }
+      if (changed)
+        LogRecord(temps);
+      break;
+    }
+#endif
+
+    default:
+      break;
+  }
+}
+
+/*
+ * @brief Sleeps until the next interrupt. With the RTC running and nothing left for the SysTick to time
+ *        (conversions, EEPROM page writes) the MCU goes into STOP, otherwise into sleep mode with the
+ *        SysTick left out until the next conversion end, monitoring read or ACK poll.
+ * @param none
+ * @retval void
+ *
+ * */
+static void SleepUntilEvent(void)
+{
+#ifdef LOG_RTC_WAKEUP
+  bool alarm_set = false;  // STOP only with an alarm for the next job, else nothing would wake the MCU
+  if (rtc_wakeup && !ArmWakeup(&alarm_set))
+    return;  // the next job is due already
+#endif
+
+  // an interrupt after the check still ends the sleep, it is taken once enabled again
+  __disable_irq();
+  if (EVENT_Pending(&event_queue) || TEMP_ArrayIsReady(&temp_array))
+  {
+    __enable_irq();
+    return;
+  }
+
+  uint32_t idle_ms = TEMP_ArrayIdleMs(&temp_array);
+  uint32_t eeprom_ms = EEPROM_IdleMs(&eeprom_handle);
+  if (eeprom_ms < idle_ms)
+    idle_ms = eeprom_ms;
+#ifdef LOG_RTC_WAKEUP
+  if (rtc_wakeup && alarm_set && (idle_ms == UINT32_MAX) && !EEPROM_IsBusy(&eeprom_handle))
+  {
+    IDLE_CountStop(WAKEUP_EnterStop());
+    SystemClock_Config();  // back on the HSI after STOP, no PLL to lock: a few register writes
+    __enable_irq();
+    return;
+  }
+#endif
+  IDLE_Sleep(idle_ms);  // until TIM2, the RTC, the ALERT line, an I2C transfer or the SysTick work;
+                        // without an RTC alarm at most a SysTick reload, the alarm is set again then
+  __enable_irq();
+}
+
+/*
+ * @brief Finds and configures the sensor of a channel, at boot and from the health check
+ * @param[1] channel index of sensor_map
+ * @param[2] true to time the conversions, blocking: at boot only, a sensor set up again by the health
+ *           check keeps the datasheet times so the main loop is not held up
+ * @retval true if the sensor answered
+ *
+ * */
+static bool SetupSensor(uint8_t channel, bool calibrate)
+{
+  TEMP_Handle *sensor = &temp_channels[channel].sensor;
+  I2C_HandleTypeDef *hi2c = sensor_map[channel].hi2c;
+  if (TEMP_InitAddr(hi2c, sensor, sensor_map[channel].addr) != TMP_READY)
+  {
+    printf("Sensor %u not found!\r\n", channel);
+    return false;
+  }
+#if (TEMP_SENSOR == TEMP_SENSOR_TMP100)
+  TMP100_SetResolution(hi2c, sensor, LOG_RESOLUTION);
+#elif (TEMP_SENSOR == TEMP_SENSOR_TMP117)
+  TMP117_SetAveraging(hi2c, sensor, LOG_AVERAGING);
+#endif
+#if (TEMP_SENSOR == TEMP_SENSOR_TMP102)
+  // readouts at the measured conversion time instead of the datasheet maximum
+  if (calibrate && (TMP100_Calibrate(hi2c, sensor, LOG_CAL_RUNS) == TMP_TIMEOUT))
+    printf("Sensor %u converts slower than specified!\r\n", channel);
+#else
+  (void)calibrate;  // the TMP100/TMP101 have no conversion done flag to time
+#endif
+#ifdef TMP_ALERT_Pin
+  // the open drain ALERT outputs share the EXTI line, any sensor leaving the band logs a record
+  TMP100_AlertConfig alert = {
+    .t_low = LOG_BAND_LOW_CENTI,
+    .t_high = LOG_BAND_HIGH_CENTI,
+    .active_high = false,
+    .faults = TMP_FAULTS_2,         // one noisy conversion does not wake the MCU
+    .mode = TMP_ALERT_INTERRUPT     // a pulse per crossing, the shared line is not held low
+  };
+  int16_t centi;
+  if (TMP100_ConfigAlert(hi2c, sensor, &alert) != TMP_READY)
+  {
+    printf("TMP100 alert setup failed!\r\n");
+  }
+  else
+  {
+    // the interrupt mode watches one edge at a time, TrackAlert points it at the one that can trip next
+    HAL_Delay(TMP100_CONV_TIME_12BIT_MS);  // first result of the continuous conversions
+    alert_zone[channel] = 0;
+    alert_threshold[channel] = TEMP_CENTI_INVALID;
+    if (TEMP_ReadTemperature(hi2c, sensor, &centi) == TMP_READY)
+      TrackAlert(channel, centi);
+  }
+#endif
+  return true;
+}
+
+#ifdef TMP_ALERT_Pin
+/*
+ * @brief Updates the band zone of a sensor and points its ALERT at the band edge it can cross next: the
+ *        way back in (LOG_BAND_HYST_CENTI inside the crossed edge) during an excursion, else the nearer
+ *        edge. The thermostat watches one edge only, the LOG_ALERT_CHECK_S re-read moves it to the other
+ *        one as the temperature drifts past the middle of the band.
+ * @param[1] channel index of sensor_map
+ * @param[2] temperature of the channel in 0.01 °C
+ * @retval true if the sensor left or re-entered the band
+ *
+ * */
+static bool TrackAlert(uint8_t channel, int16_t centi)
+{
+  int8_t zone = alert_zone[channel];
+  if (centi > LOG_BAND_HIGH_CENTI)
+    zone = 1;
+  else if (centi < LOG_BAND_LOW_CENTI)
+    zone = -1;
+  else if (((zone > 0) && (centi < LOG_BAND_HIGH_CENTI - LOG_BAND_HYST_CENTI)) ||
+           ((zone < 0) && (centi > LOG_BAND_LOW_CENTI + LOG_BAND_HYST_CENTI)))
+    zone = 0;
+
+  int16_t threshold;
+  if (zone > 0)
+    threshold = LOG_BAND_HIGH_CENTI - LOG_BAND_HYST_CENTI;
+  else if (zone < 0)
+    threshold = LOG_BAND_LOW_CENTI + LOG_BAND_HYST_CENTI;
+  else
+    threshold = (centi >= (LOG_BAND_LOW_CENTI + LOG_BAND_HIGH_CENTI) / 2) ? LOG_BAND_HIGH_CENTI : LOG_BAND_LOW_CENTI;
+
+  // only a new threshold is written, rewriting may fire the thermostat once to turn it round
+  if ((threshold != alert_threshold[channel]) &&
+      (TMP100_ArmAlert(sensor_map[channel].hi2c, &temp_channels[channel].sensor, threshold) == TMP_READY))
+    alert_threshold[channel] = threshold;
+
+  bool changed = (zone != alert_zone[channel]);
+  alert_zone[channel] = zone;
+  return changed;
+}
+#endif
+
+/*
+ * @brief Arms the flush job for the second the oldest staged record reaches LOG_FLUSH_AGE_S, or stops it
+ *        with nothing staged, so the job never wakes the MCU for nothing
+ * @param none
+ * @retval void
+ *
+ * */
+static void ScheduleFlush(void)
+{
+  uint32_t due = EEPROM_FlushDueIn(&eeprom_handle);
+  if (due == UINT32_MAX)
+    WHEEL_Stop(&wheel, &flush_timer);
+  else
+    WHEEL_Start(&wheel, &flush_timer, due, 0, EVT_FLUSH_CHECK);
+}
+
+/*
+ * @brief Time base of the timer wheel
+ * @param none
+ * @retval RTC counter with the RTC running, TIM2 uptime otherwise
+ *
+ * */
+static uint32_t LogSeconds(void)
+{
+#ifdef LOG_RTC_WAKEUP
+  if (rtc_wakeup)
+    return WAKEUP_Seconds();
+#endif
+  return uptime_s;
+}
+
+#ifdef LOG_ADAPTIVE
+/*
+ * @brief Picks the next sampling interval from the fastest changing sensor of the record just logged:
+ *        halved while one moves faster than LOG_ADAPT_FAST_CPM, doubled while all move slower than
+ *        LOG_ADAPT_SLOW_CPM, kept in between so the compressor cycle does not toggle it
+ * @param temperatures of the record in 0.01 °C
+ * @retval void
+ *
+ * */
+static void AdaptInterval(const int16_t *temps)
+{
+  int32_t fastest = -1;  // largest change since the record before, of a sensor valid in both
+  for (uint8_t i = 0; i < LOG_SENSOR_COUNT; i++)
+  {
+    if (have_last && (temps[i] != TEMP_CENTI_INVALID) && (last_temps[i] != TEMP_CENTI_INVALID))
+    {
+      int32_t delta = (int32_t)temps[i] - last_temps[i];
+      if (delta < 0)
+        delta = -delta;
+      if (delta > fastest)
+        fastest = delta;
+    }
+    last_temps[i] = temps[i];
+  }
+  have_last = true;
+  if (fastest < 0)
+    return;  // no rate without two results of a sensor
+
+  // rate in 0.01 °C per minute against the thresholds, without a division
+  uint16_t interval = sample_interval;
+  if (fastest * 60 >= (int32_t)LOG_ADAPT_FAST_CPM * sample_interval)
+    interval = (sample_interval / 2 > LOG_ADAPT_MIN_S) ? sample_interval / 2 : LOG_ADAPT_MIN_S;
+  else if (fastest * 60 < (int32_t)LOG_ADAPT_SLOW_CPM * sample_interval)
+    interval = (sample_interval * 2 < LOG_INTERVAL_S) ? sample_interval * 2 : LOG_INTERVAL_S;
+  if (interval == sample_interval)
+    return;
+
+  // the next sample comes one new interval after the one just logged, the grid moves with it
+  uint32_t since = wheel.now - sample_second;
+  WHEEL_Start(&wheel, &sample_timer, (since < interval) ? interval - since : 0, interval, EVT_SAMPLE_DUE);
+  sample_interval = interval;
+}
+#endif
+
+#ifdef LOG_RTC_WAKEUP
+/*
+ * @brief Sets the RTC alarm to the next deadline of the wheel, the RTC is only written when it moved
+ * @param alarm_set used to return whether the alarm is valid for the deadline, STOP must not be entered otherwise
+ * @retval false if the deadline has passed meanwhile, the alarm would not fire then
+ *
+ * */
+static bool ArmWakeup(bool *alarm_set)
+{
+  uint32_t deadline;
+  if (!WHEEL_NextDeadline(&wheel, &deadline))
+  {
+    *alarm_set = true;  // no job, only the ALERT line wakes the MCU
+    return true;
+  }
+
+  if (deadline != alarm_second)
+  {
+    if (WAKEUP_SetAlarm(deadline) != HAL_OK)
+    {
+      printf("RTC alarm failed!\r\n");
+      alarm_second = UINT32_MAX;  // the alarm register is unknown now, set again on the next pass
+    }
+    else
+      alarm_second = deadline;
+  }
+  *alarm_set = (deadline == alarm_second);
+  return ((int32_t)(deadline - WAKEUP_Seconds()) > 0);
+}
+#endif
 
 /* USER CODE END 0 */
 
@@ -98,11 +531,49 @@ int main(void)
 
   /* Initialize all configured peripherals */
   MX_GPIO_Init();
+  MX_DMA_Init();
   MX_I2C1_Init();
   MX_I2C2_Init();
   MX_TIM2_Init();
   /* USER CODE BEGIN 2 */
-  if((TMP100_CheckStatus(&hi2c2) == TMP_READY) && (EEPROM_Init(&hi2c1, &eeprom_handle) == HAL_OK)){ //check if the TMP100 is available and also the restore eeprom pointer after last boot
+  bool sensor_found = false;
+  for (uint8_t i = 0; i < LOG_SENSOR_COUNT; i++)
+  {
+	  // a missing sensor keeps its channel, logged as invalid until the health check finds it
+	  if (SetupSensor(i, true))
+	      sensor_found = true;
+	  else
+	      sensor_faults |= (uint16_t)(1u << i);
+  }
+  TEMP_ArraySetBurst(&temp_array, LOG_BURST, LOG_FILTER);
+  if(sensor_found && (EEPROM_Init(&hi2c1, &eeprom_handle) == HAL_OK)){ //check if a sensor is available and also the restore eeprom pointer after last boot
+	  // a partial page is committed once its oldest record is LOG_FLUSH_AGE_S old, not only when full
+	  EEPROM_SetFlushPolicy(&eeprom_handle, EEPROM_FLUSH_EVERY_T, LOG_FLUSH_AGE_S);
+#ifdef LOG_MONITOR_PERIOD_MS
+	  // the SysTick times the reads, TEMP_ArrayFetch hands out one decimated record per LOG_MONITOR_DECIM of them
+	  if(TEMP_ArraySetContinuous(&temp_array, LOG_MONITOR_PERIOD_MS, LOG_MONITOR_DECIM) != TMP_READY){
+	      printf("Sensor monitor mode failed!\r\n");
+	  }
+#endif
+#ifdef LOG_RTC_WAKEUP
+	  if(WAKEUP_Init() == HAL_OK){
+	      rtc_wakeup = true;
+	  }
+	  else{
+	      printf("RTC failed, TIM2 schedules the records!\r\n");
+	  }
+#endif
+	  WHEEL_Init(&wheel, LogSeconds());
+#ifdef LOG_PERIODIC
+	  WHEEL_Start(&wheel, &sample_timer, LOG_INTERVAL_S, LOG_INTERVAL_S, EVT_SAMPLE_DUE);
+#endif
+	  WHEEL_Start(&wheel, &health_timer, LOG_HEALTH_INTERVAL_S, LOG_HEALTH_INTERVAL_S, EVT_HEALTH_CHECK);
+#ifdef TMP_ALERT_Pin
+	  WHEEL_Start(&wheel, &alert_timer, LOG_ALERT_CHECK_S, LOG_ALERT_CHECK_S, EVT_ALERT);
+#endif
+#ifdef LOG_RTC_WAKEUP
+	  if(!rtc_wakeup)
+#endif
 	  HAL_TIM_Base_Start_IT(&htim2);  // start timer with interrupt
   }
 
@@ -115,6 +586,43 @@ int main(void)
     /* USER CODE END WHILE */
 
     /* USER CODE BEGIN 3 */
+    // the drivers only run from here, the interrupts just queue events
+    EVENT_ID event;
+    while (EVENT_Pop(&event_queue, &event))
+    {
+      DispatchEvent(event);
+    }
+    WHEEL_Advance(&wheel, LogSeconds());  // the due jobs run like the interrupt events
+    while (WHEEL_Expired(&wheel, &event))
+    {
+      DispatchEvent(event);
+    }
+
+    int16_t temps[LOG_SENSOR_COUNT];
+    if (TEMP_ArrayIsReady(&temp_array))
+    {
+      // inside a burst this triggers the next conversions, a record only comes with the last one;
+      // in monitoring mode it is one read, a record only comes with the last of the decimation
+      TEMP_STATUS status = TEMP_ArrayFetch(&temp_array, temps);
+      if (status != TMP_BUSY)
+      {
+        if (status != TMP_READY)
+          printf("Sensor I2C Read Failed!\r\n");
+        LogRecord(temps);  // the channels that were read are still logged
+#ifdef LOG_ADAPTIVE
+        AdaptInterval(temps);
+#endif
+#ifdef LOG_IDLE_STATS
+        IDLE_Stats stats;
+        IDLE_GetStats(&stats);
+        uint16_t duty = IDLE_DutyPermille();
+        printf("Awake %u.%u %%, %lu sleeps, %lu stops, %lu ticks skipped\r\n", duty / 10, duty % 10,
+               stats.sleeps, stats.stops, stats.ticks_skipped);
+        IDLE_ResetStats();
+#endif
+      }
+    }
+    SleepUntilEvent();
   }
   /* USER CODE END 3 */
 }
@@ -268,6 +776,22 @@ static void MX_TIM2_Init(void)
 
 }
 
+/**
+  * Enable DMA controller clock
+  */
+static void MX_DMA_Init(void)
+{
+
+  /* DMA controller clock enable */
+  __HAL_RCC_DMA1_CLK_ENABLE();
+
+  /* DMA interrupt init */
+  /* DMA1_Channel7_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Channel7_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel7_IRQn);
+
+}
+
 /**
   * @brief GPIO Initialization Function
   * @param None
@@ -283,7 +807,17 @@ static void MX_GPIO_Init(void)
   __HAL_RCC_GPIOB_CLK_ENABLE();
 
   /* USER CODE BEGIN MX_GPIO_Init_2 */
-
+#ifdef TMP_ALERT_Pin
+  // open drain ALERT, active low
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+  GPIO_InitStruct.Pin = TMP_ALERT_Pin;
+  GPIO_InitStruct.Mode = GPIO_MODE_IT_FALLING;
+  GPIO_InitStruct.Pull = GPIO_PULLUP;
+  HAL_GPIO_Init(TMP_ALERT_GPIO_Port, &GPIO_InitStruct);
+
+  HAL_NVIC_SetPriority(TMP_ALERT_EXTI_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(TMP_ALERT_EXTI_IRQn);
+#endif
   /* USER CODE END MX_GPIO_Init_2 */
 }
 
@@ -292,28 +826,55 @@ void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
 {
   if (htim->Instance == TIM2)
   {
-    second_counter++;
+    uptime_s++;
+    EVENT_Push(&event_queue, EVT_WHEEL_TICK);  // the main loop advances the wheel to the new second
+  }
+}
 
-    if (second_counter >= 600)  // 10 minutes 1sec timer
-    {
-      second_counter = 0;
+// EEPROM page writes run on interrupts, I2C1 shares TIM2's priority so neither preempts the other
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+  if (hi2c->Instance == I2C1)
+    EEPROM_TxCpltHandler(&eeprom_handle);
+}
 
-      float temp = 0.0;
-      if(TMP100_ReadTemperature_OneShot(&hi2c2, &temp) == TMP_READY)
-      {
+void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+  if (hi2c->Instance == I2C1)
+    EEPROM_TxCpltHandler(&eeprom_handle);
+}
 
-    	  int16_t temp_fixed = (int16_t)(temp * 100);
-    	  uint8_t data[2] = {
-    			  (uint8_t)(temp_fixed >> 8),
-				  (uint8_t)(temp_fixed & 0xFF)
-    	  	  	  };
-    	  EEPROM_WriteBytes(&hi2c1,  &eeprom_handle, data, 2);
-      }
-      else{
-    	  printf("TMP100 I2C Read Failed!\r\n");
-      }
-    }
-  }
+void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+  if (hi2c->Instance == I2C1)
+    EEPROM_RxCpltHandler(&eeprom_handle);  // EEPROM_ReadStream frames (DMA)
+}
+
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+  if (hi2c->Instance == I2C1)
+    EEPROM_ErrorHandler(&eeprom_handle);
+}
+
+#ifdef LOG_RTC_WAKEUP
+void WAKEUP_AlarmCallback(void)
+{
+  EVENT_Push(&event_queue, EVT_WHEEL_TICK);  // also wakes the main loop from STOP
+}
+#endif
+
+#ifdef TMP_ALERT_Pin
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
+{
+  if (GPIO_Pin == TMP_ALERT_Pin)
+    EVENT_Push(&event_queue, EVT_ALERT);
+}
+#endif
+
+void HAL_SYSTICK_Callback(void)
+{
+  EEPROM_TickHandler(&eeprom_handle);  // ACK polling during the EEPROM write cycle
+  TEMP_ArrayTickHandler(&temp_array);  // end of the one-shot conversion time
 }
 /* USER CODE END 4 */
 
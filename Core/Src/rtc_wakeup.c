@@ -0,0 +1,244 @@
+/*
+ * rtc_wakeup.c
+ *
+ *  RTC alarm and STOP mode, see rtc_wakeup.h
+ */
+#include "rtc_wakeup.h"
+
+#define WAKEUP_SYNC_SPINS            10000         // RSF after STOP takes 2 RTC clocks, about 500 core cycles
+
+static uint32_t wakeup_prescaler = WAKEUP_LSE_PRESCALER;  // PRL is write only, kept for the sub-second part
+
+/*Static function declaration
+ * */
+static HAL_StatusTypeDef WAKEUP_WaitFlag(volatile uint32_t *reg, uint32_t flag, uint32_t timeout);
+static HAL_StatusTypeDef WAKEUP_EnterConfig(void);
+static HAL_StatusTypeDef WAKEUP_ExitConfig(void);
+static uint32_t WAKEUP_Millis(void);
+
+/*
+ * @brief Starts the RTC as a 1 Hz counter and enables the alarm interrupt. A counter that survived a reset
+ *        on the backup domain is kept running, only the first start after a power loss picks the clock.
+ * @param none
+ * @retval HAL_Status, HAL_ERROR if neither the LSE nor the LSI starts
+ *
+ * */
+HAL_StatusTypeDef WAKEUP_Init(void)
+{
+    __HAL_RCC_PWR_CLK_ENABLE();
+    __HAL_RCC_BKP_CLK_ENABLE();
+    HAL_PWR_EnableBkUpAccess();  // stays enabled, the alarm is written on every sample
+
+    if (!(RCC->BDCR & RCC_BDCR_RTCEN))
+    {
+        uint32_t clock = RCC_BDCR_RTCSEL_LSE;
+        RCC->BDCR |= RCC_BDCR_LSEON;
+        if (WAKEUP_WaitFlag(&RCC->BDCR, RCC_BDCR_LSERDY, WAKEUP_LSE_TIMEOUT_MS) != HAL_OK)
+        {
+            RCC->BDCR &= ~RCC_BDCR_LSEON;  // no crystal fitted, the LSI keeps the scheduler going
+            clock = RCC_BDCR_RTCSEL_LSI;
+        }
+        RCC->BDCR = (RCC->BDCR & ~RCC_BDCR_RTCSEL) | clock;
+        RCC->BDCR |= RCC_BDCR_RTCEN;
+    }
+
+    if ((RCC->BDCR & RCC_BDCR_RTCSEL) == RCC_BDCR_RTCSEL_LSI)
+    {
+        // the LSI is not in the backup domain, every reset stops it
+        RCC->CSR |= RCC_CSR_LSION;
+        if (WAKEUP_WaitFlag(&RCC->CSR, RCC_CSR_LSIRDY, WAKEUP_SYNC_TIMEOUT_MS) != HAL_OK)
+            return HAL_ERROR;
+        wakeup_prescaler = WAKEUP_LSI_PRESCALER;
+    }
+    else
+    {
+        wakeup_prescaler = WAKEUP_LSE_PRESCALER;
+    }
+
+    RTC->CRL &= ~RTC_CRL_RSF;
+    if (WAKEUP_WaitFlag(&RTC->CRL, RTC_CRL_RSF, WAKEUP_SYNC_TIMEOUT_MS) != HAL_OK)
+        return HAL_ERROR;
+
+    if (WAKEUP_EnterConfig() != HAL_OK)
+        return HAL_ERROR;
+    RTC->PRLH = (uint16_t)(wakeup_prescaler >> 16);
+    RTC->PRLL = (uint16_t)(wakeup_prescaler & 0xFFFF);
+    if (WAKEUP_ExitConfig() != HAL_OK)
+        return HAL_ERROR;
+
+    // the alarm reaches the NVIC through EXTI line 17, which also ends STOP
+    RTC->CRL &= ~RTC_CRL_ALRF;
+    RTC->CRH |= RTC_CRH_ALRIE;
+    EXTI->PR = WAKEUP_EXTI_LINE;
+    EXTI->RTSR |= WAKEUP_EXTI_LINE;
+    EXTI->IMR |= WAKEUP_EXTI_LINE;
+    HAL_NVIC_SetPriority(RTC_Alarm_IRQn, 0, 0);
+    HAL_NVIC_EnableIRQ(RTC_Alarm_IRQn);
+    return HAL_OK;
+}
+
+/*
+ * @brief Whether the RTC runs on the crystal, on the LSI the deadlines drift with its tolerance
+ * @param none
+ * @retval true for the LSE
+ *
+ * */
+bool WAKEUP_OnLSE(void)
+{
+    return ((RCC->BDCR & RCC_BDCR_RTCSEL) == RCC_BDCR_RTCSEL_LSE);
+}
+
+/*
+ * @brief Reads the RTC counter
+ * @param none
+ * @retval seconds since the first start of the RTC
+ *
+ * */
+uint32_t WAKEUP_Seconds(void)
+{
+    uint32_t high = RTC->CNTH;
+    uint32_t low = RTC->CNTL;
+    if (high != RTC->CNTH)  // CNTL wrapped in between
+    {
+        high = RTC->CNTH;
+        low = RTC->CNTL;
+    }
+    return (high << 16) | low;
+}
+
+/*
+ * @brief Sets the alarm to an absolute counter value, so deadlines computed as last deadline plus
+ *        interval do not drift by the time spent logging
+ * @param second of WAKEUP_Seconds to wake at
+ * @retval HAL_Status
+ *
+ * */
+HAL_StatusTypeDef WAKEUP_SetAlarm(uint32_t second)
+{
+    if (WAKEUP_EnterConfig() != HAL_OK)
+        return HAL_ERROR;
+    RTC->ALRH = (uint16_t)(second >> 16);
+    RTC->ALRL = (uint16_t)(second & 0xFFFF);
+    return WAKEUP_ExitConfig();
+}
+
+/*
+ * @brief Enters STOP with the regulator in low power until any EXTI line (RTC alarm, ALERT) fires, then
+ *        advances the HAL tick by the time slept. Call it with the interrupts disabled after checking
+ *        there is nothing to do, the wake up interrupt is taken once they are enabled again. The MCU
+ *        comes back on the HSI, the caller restores the clock tree before anything else.
+ * @param none
+ * @retval ms spent in STOP, 0 if the RTC did not resynchronise
+ *
+ * */
+uint32_t WAKEUP_EnterStop(void)
+{
+    uint32_t before = WAKEUP_Millis();
+
+    HAL_SuspendTick();
+    HAL_PWR_EnterSTOPMode(PWR_LOWPOWERREGULATOR_ON, PWR_STOPENTRY_WFI);
+    HAL_ResumeTick();
+
+    // the APB1 clock was stopped, the counter reads stale until the registers are synchronised again;
+    // the tick is not running here, so the wait is bounded by a spin count
+    RTC->CRL &= ~RTC_CRL_RSF;
+    for (uint32_t spins = WAKEUP_SYNC_SPINS; !(RTC->CRL & RTC_CRL_RSF); spins--)
+    {
+        if (spins == 0)
+            return 0;  // tick left behind, the RTC deadlines are still met
+    }
+    uint32_t slept = WAKEUP_Millis() - before;
+    uwTick += slept;
+    return slept;
+}
+
+/*
+ * @brief To be called from RTC_Alarm_IRQHandler
+ * @param none
+ * @retval void
+ *
+ * */
+void WAKEUP_IRQHandler(void)
+{
+    if (RTC->CRL & RTC_CRL_ALRF)
+    {
+        RTC->CRL &= ~RTC_CRL_ALRF;
+        WAKEUP_AlarmCallback();
+    }
+    EXTI->PR = WAKEUP_EXTI_LINE;
+}
+
+/*
+ * @brief Called from the RTC alarm interrupt, override in the application
+ * @param none
+ * @retval void
+ *
+ * */
+__weak void WAKEUP_AlarmCallback(void)
+{
+}
+
+/*
+ * @brief Static function to wait for a flag with the HAL tick running
+ * @param[1] register
+ * @param[2] flag to be set
+ * @param[3] timeout in ms
+ * @retval HAL_Status
+ *
+ * */
+static HAL_StatusTypeDef WAKEUP_WaitFlag(volatile uint32_t *reg, uint32_t flag, uint32_t timeout)
+{
+    uint32_t start = HAL_GetTick();
+    while (!(*reg & flag))
+    {
+        if ((HAL_GetTick() - start) >= timeout)
+            return HAL_TIMEOUT;
+    }
+    return HAL_OK;
+}
+
+/*
+ * @brief Static function to open the RTC for writing PRL, CNT or ALR
+ * @param none
+ * @retval HAL_Status
+ *
+ * */
+static HAL_StatusTypeDef WAKEUP_EnterConfig(void)
+{
+    if (WAKEUP_WaitFlag(&RTC->CRL, RTC_CRL_RTOFF, WAKEUP_SYNC_TIMEOUT_MS) != HAL_OK)
+        return HAL_TIMEOUT;
+    RTC->CRL |= RTC_CRL_CNF;
+    return HAL_OK;
+}
+
+/*
+ * @brief Static function to close the RTC configuration and wait until the write reached the RTC domain
+ * @param none
+ * @retval HAL_Status
+ *
+ * */
+static HAL_StatusTypeDef WAKEUP_ExitConfig(void)
+{
+    RTC->CRL &= ~RTC_CRL_CNF;
+    return WAKEUP_WaitFlag(&RTC->CRL, RTC_CRL_RTOFF, WAKEUP_SYNC_TIMEOUT_MS);
+}
+
+/*
+ * @brief Static function to read the RTC with the sub-second part of the prescaler
+ * @param none
+ * @retval ms, wraps; only differences are used
+ *
+ * */
+static uint32_t WAKEUP_Millis(void)
+{
+    uint32_t seconds;
+    uint32_t div;
+    do
+    {
+        seconds = WAKEUP_Seconds();
+        div = ((uint32_t)(RTC->DIVH & 0x000F) << 16) | RTC->DIVL;
+    } while (seconds != WAKEUP_Seconds());
+
+    // DIV counts down from PRL to 0 within each second
+    return seconds * 1000U + ((wakeup_prescaler - div) * 1000U) / (wakeup_prescaler + 1U);
+}
@@ -0,0 +1,298 @@
+/*
+ * timer_wheel.c
+ *
+ *  Hierarchical timer wheel, see timer_wheel.h
+ */
+#include "timer_wheel.h"
+#include "string.h"
+
+/*Static function declaration
+ * */
+static void WHEEL_Insert(WHEEL_Handle *wheel, WHEEL_Timer *timer);
+static void WHEEL_Link(WHEEL_Handle *wheel, WHEEL_Timer *timer, uint8_t level, uint8_t slot);
+static void WHEEL_Unlink(WHEEL_Handle *wheel, WHEEL_Timer *timer);
+static void WHEEL_Cascade(WHEEL_Handle *wheel, uint8_t level, uint8_t slot);
+static uint32_t WHEEL_NextStop(WHEEL_Handle *wheel, uint32_t limit);
+static uint32_t WHEEL_NextSlot(uint32_t occupied, uint32_t now);
+
+/*
+ * @brief Empties the wheel
+ * @param[1] wheel pointer
+ * @param[2] current second of the time base, RTC counter or uptime
+ * @retval void
+ *
+ * */
+void WHEEL_Init(WHEEL_Handle *wheel, uint32_t now)
+{
+    memset(wheel, 0, sizeof(*wheel));
+    wheel->now = now;
+}
+
+/*
+ * @brief Arms a timer, a running one is re-armed. A periodic timer stays on the grid of its first expiry,
+ *        runs missed by a late advance are skipped, not caught up.
+ * @param[1] wheel pointer
+ * @param[2] timer pointer, owned by the caller until stopped
+ * @param[3] seconds from the current wheel second to the first run, 0 fires at the next advance
+ * @param[4] seconds between runs, 0 for a one-shot
+ * @param[5] event handed out by WHEEL_Expired
+ * @retval void
+ *
+ * */
+void WHEEL_Start(WHEEL_Handle *wheel, WHEEL_Timer *timer, uint32_t delay, uint32_t period, EVENT_ID event)
+{
+    WHEEL_Stop(wheel, timer);
+    timer->expiry = wheel->now + delay;
+    timer->period = period;
+    timer->event = event;
+    timer->armed = true;
+    WHEEL_Insert(wheel, timer);
+}
+
+/*
+ * @brief Disarms a timer, an expired one that was not handed out yet is dropped as well
+ * @param[1] wheel pointer
+ * @param[2] timer pointer
+ * @retval void
+ *
+ * */
+void WHEEL_Stop(WHEEL_Handle *wheel, WHEEL_Timer *timer)
+{
+    if (!timer->armed)
+        return;
+    WHEEL_Unlink(wheel, timer);
+    timer->armed = false;
+}
+
+/*
+ * @brief Moves the wheel to the current second, the timers due up to it are put on the expired list.
+ *        Empty slots are skipped, so a wake up after a long STOP costs a step per filled slot only.
+ * @param[1] wheel pointer
+ * @param[2] current second of the time base
+ * @retval void
+ *
+ * */
+void WHEEL_Advance(WHEEL_Handle *wheel, uint32_t now)
+{
+    while ((int32_t)(now - wheel->now) > 0)
+    {
+        uint32_t t = WHEEL_NextStop(wheel, now);
+        wheel->now = t;
+
+        // the upper levels first, their timers may be due in this very second
+        for (uint8_t level = WHEEL_LEVELS - 1; level > 0; level--)
+        {
+            uint8_t shift = WHEEL_SLOT_BITS * level;
+            if ((t & ((1UL << shift) - 1U)) == 0)
+                WHEEL_Cascade(wheel, level, (uint8_t)((t >> shift) & WHEEL_SLOT_MASK));
+        }
+        WHEEL_Cascade(wheel, 0, (uint8_t)(t & WHEEL_SLOT_MASK));
+    }
+}
+
+/*
+ * @brief Hands out the next expired timer, a periodic one is armed again for its next run
+ * @param[1] wheel pointer
+ * @param[2] event used to return the event of the timer
+ * @retval false if no timer is due
+ *
+ * */
+bool WHEEL_Expired(WHEEL_Handle *wheel, EVENT_ID *event)
+{
+    WHEEL_Timer *timer = wheel->expired;
+    if (timer == NULL)
+        return false;
+
+    WHEEL_Unlink(wheel, timer);
+    *event = timer->event;
+    if (timer->period == 0)
+    {
+        timer->armed = false;
+        return true;
+    }
+
+    do
+    {
+        timer->expiry += timer->period;
+    } while ((int32_t)(timer->expiry - wheel->now) <= 0);
+    WHEEL_Insert(wheel, timer);
+    return true;
+}
+
+/*
+ * @brief Earliest expiry of all armed timers, for the RTC alarm of the low power path. Level 0 is read
+ *        from the occupied mask, the timers of the upper levels are compared one by one.
+ * @param[1] wheel pointer
+ * @param[2] second used to return the deadline, the current wheel second if a timer is due already
+ * @retval false if no timer is armed
+ *
+ * */
+bool WHEEL_NextDeadline(WHEEL_Handle *wheel, uint32_t *second)
+{
+    if (wheel->expired != NULL)
+    {
+        *second = wheel->now;
+        return true;
+    }
+
+    uint32_t best = UINT32_MAX;  // seconds from now
+    if (wheel->occupied[0] != 0)
+        best = WHEEL_NextSlot(wheel->occupied[0], wheel->now);
+
+    for (uint8_t level = 1; level < WHEEL_LEVELS; level++)
+    {
+        for (uint8_t slot = 0; slot < WHEEL_SLOTS; slot++)
+        {
+            if (!(wheel->occupied[level] & (1UL << slot)))
+                continue;
+            for (WHEEL_Timer *timer = wheel->slots[level][slot]; timer != NULL; timer = timer->next)
+            {
+                uint32_t delta = timer->expiry - wheel->now;
+                if (delta < best)
+                    best = delta;
+            }
+        }
+    }
+
+    if (best == UINT32_MAX)
+        return false;
+    *second = wheel->now + best;
+    return true;
+}
+
+/*
+ * @brief Static function to file a timer by its expiry, relative to the current wheel second
+ * @param[1] wheel pointer
+ * @param[2] timer pointer
+ * @retval void
+ *
+ * */
+static void WHEEL_Insert(WHEEL_Handle *wheel, WHEEL_Timer *timer)
+{
+    uint32_t delta = timer->expiry - wheel->now;
+    if (delta == 0 || delta > INT32_MAX)
+    {
+        WHEEL_Link(wheel, timer, WHEEL_LEVELS, 0);  // due or late
+        return;
+    }
+
+    uint8_t level = 0;
+    while ((level < WHEEL_LEVELS - 1) && (delta >= (1UL << (WHEEL_SLOT_BITS * (level + 1)))))
+        level++;
+
+    // beyond the span the timer waits in the farthest slot and is filed again from there
+    uint32_t expiry = (delta < WHEEL_SPAN) ? timer->expiry : wheel->now + WHEEL_SPAN - 1U;
+    WHEEL_Link(wheel, timer, level, (uint8_t)((expiry >> (WHEEL_SLOT_BITS * level)) & WHEEL_SLOT_MASK));
+}
+
+/*
+ * @brief Static function to put a timer at the head of a slot list, or of the expired list
+ * @param[1] wheel pointer
+ * @param[2] timer pointer
+ * @param[3] level, WHEEL_LEVELS for the expired list
+ * @param[4] slot of the level
+ * @retval void
+ *
+ * */
+static void WHEEL_Link(WHEEL_Handle *wheel, WHEEL_Timer *timer, uint8_t level, uint8_t slot)
+{
+    WHEEL_Timer **head = (level < WHEEL_LEVELS) ? &wheel->slots[level][slot] : &wheel->expired;
+    timer->level = level;
+    timer->slot = slot;
+    timer->prev = NULL;
+    timer->next = *head;
+    if (*head != NULL)
+        (*head)->prev = timer;
+    *head = timer;
+    if (level < WHEEL_LEVELS)
+        wheel->occupied[level] |= (1UL << slot);
+}
+
+/*
+ * @brief Static function to take a timer off its list
+ * @param[1] wheel pointer
+ * @param[2] timer pointer
+ * @retval void
+ *
+ * */
+static void WHEEL_Unlink(WHEEL_Handle *wheel, WHEEL_Timer *timer)
+{
+    WHEEL_Timer **head = (timer->level < WHEEL_LEVELS) ? &wheel->slots[timer->level][timer->slot] : &wheel->expired;
+    if (timer->prev != NULL)
+        timer->prev->next = timer->next;
+    else
+        *head = timer->next;
+    if (timer->next != NULL)
+        timer->next->prev = timer->prev;
+    timer->next = NULL;
+    timer->prev = NULL;
+    if ((timer->level < WHEEL_LEVELS) && (*head == NULL))
+        wheel->occupied[timer->level] &= ~(1UL << timer->slot);
+}
+
+/*
+ * @brief Static function to file the timers of a slot again at the current wheel second: one level down,
+ *        or onto the expired list for level 0
+ * @param[1] wheel pointer
+ * @param[2] level
+ * @param[3] slot of the level
+ * @retval void
+ *
+ * */
+static void WHEEL_Cascade(WHEEL_Handle *wheel, uint8_t level, uint8_t slot)
+{
+    WHEEL_Timer *timer = wheel->slots[level][slot];
+    wheel->slots[level][slot] = NULL;
+    wheel->occupied[level] &= ~(1UL << slot);
+
+    while (timer != NULL)
+    {
+        WHEEL_Timer *next = timer->next;
+        WHEEL_Insert(wheel, timer);
+        timer = next;
+    }
+}
+
+/*
+ * @brief Static function to find the next second the wheel has work at: a filled level 0 slot or, with
+ *        timers on the upper levels, the next cascade
+ * @param[1] wheel pointer
+ * @param[2] second to stop at the latest
+ * @retval wheel second
+ *
+ * */
+static uint32_t WHEEL_NextStop(WHEEL_Handle *wheel, uint32_t limit)
+{
+    uint32_t step = limit - wheel->now;
+    if (wheel->occupied[0] != 0)
+    {
+        uint32_t slot = WHEEL_NextSlot(wheel->occupied[0], wheel->now);
+        if (slot < step)
+            step = slot;
+    }
+    for (uint8_t level = 1; level < WHEEL_LEVELS; level++)
+    {
+        if (wheel->occupied[level] != 0)
+        {
+            uint32_t cascade = WHEEL_SLOTS - (wheel->now & WHEEL_SLOT_MASK);
+            if (cascade < step)
+                step = cascade;
+            break;
+        }
+    }
+    return wheel->now + step;
+}
+
+/*
+ * @brief Static function to find the first filled level 0 slot after the current second
+ * @param[1] occupied mask of level 0, not 0
+ * @param[2] current wheel second
+ * @retval seconds to it, 1 to WHEEL_SLOTS
+ *
+ * */
+static uint32_t WHEEL_NextSlot(uint32_t occupied, uint32_t now)
+{
+    uint32_t first = (now + 1U) & WHEEL_SLOT_MASK;
+    uint32_t rotated = (first == 0) ? occupied : ((occupied >> first) | (occupied << (WHEEL_SLOTS - first)));
+    return __CLZ(__RBIT(rotated)) + 1U;  // count of trailing zeros
+}
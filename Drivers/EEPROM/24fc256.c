@@ -10,18 +10,65 @@
 
 /* Static function defs
  * */
-static HAL_StatusTypeDef EEPROM_WaitForWriteCompletion(I2C_HandleTypeDef *hi2c);
+static HAL_StatusTypeDef EEPROM_WaitForWriteCompletion(I2C_HandleTypeDef *hi2c, uint16_t dev);
+static HAL_StatusTypeDef EEPROM_WriteRaw(I2C_HandleTypeDef *hi2c, uint16_t dev, uint16_t addr, const uint8_t *data, uint16_t size);
+static HAL_StatusTypeDef EEPROM_WriteSegments(I2C_HandleTypeDef *hi2c, uint16_t dev, uint16_t addr, const EEPROM_Segment *seg, uint8_t count);
+static HAL_StatusTypeDef EEPROM_SendFrame(I2C_HandleTypeDef *hi2c, uint16_t dev, const uint8_t *data, uint16_t len, uint32_t option);
+static HAL_StatusTypeDef EEPROM_ReadLegacyRing(I2C_HandleTypeDef *hi2c, uint32_t offset, uint8_t *data, uint16_t size);
+static HAL_StatusTypeDef EEPROM_CommitStage(EEPROM_Handle *handle);
+static void EEPROM_AdvanceHead(EEPROM_Handle *handle);
+static uint8_t *EEPROM_FreeStagePage(EEPROM_Handle *handle);
+static void EEPROM_UpdatePointers(EEPROM_Handle *handle);
+static bool EEPROM_FlushDue(EEPROM_Handle *handle);
+static uint8_t EEPROM_Crc8(const uint8_t *data, uint8_t len);
+static uint16_t EEPROM_BlockAddr(uint16_t block);
+static uint8_t EEPROM_BlockChip(uint16_t block);
+static uint16_t EEPROM_BlockDev(uint16_t block);
+static uint16_t EEPROM_PhysBlock(uint8_t chip, uint16_t addr);
+static uint16_t EEPROM_BlockNext(uint16_t block);
+static void EEPROM_PackHeader(uint8_t *hdr, uint16_t seq, uint8_t fill);
+static HAL_StatusTypeDef EEPROM_ReadHeader(I2C_HandleTypeDef *hi2c, uint16_t dev, uint16_t addr, uint16_t *seq, uint8_t *fill, bool *valid);
+static HAL_StatusTypeDef EEPROM_RestoreLegacyMetadata(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle);
+static HAL_StatusTypeDef EEPROM_ConvertLegacyLog(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle, uint16_t write_ptr, bool has_wrapped);
+static uint16_t EEPROM_Layout2Addr(uint16_t block);
+static HAL_StatusTypeDef EEPROM_MigrateLayout2(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle);
+static HAL_StatusTypeDef EEPROM_FindHead(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle);
+static HAL_StatusTypeDef EEPROM_TrimHead(I2C_HandleTypeDef *hi2c, uint16_t anchor, uint16_t anchor_seq, uint16_t *lo);
+static HAL_StatusTypeDef EEPROM_AbandonLog(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle);
+static void EEPROM_ResetLog(EEPROM_Handle *handle, uint16_t block, uint16_t seq);
+static HAL_StatusTypeDef EEPROM_StoreAnchor(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle);
+static void EEPROM_RaiseFloor(EEPROM_Handle *handle);
+static HAL_StatusTypeDef EEPROM_NewGeneration(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle, uint16_t block);
+static void EEPROM_PackRecord(EEPROM_Handle *handle, uint8_t *rec);
+static bool EEPROM_JobActive(EEPROM_Handle *handle);
+static bool EEPROM_JobsIdle(EEPROM_Handle *handle);
+static bool EEPROM_JobFailed(EEPROM_Handle *handle);
+static bool EEPROM_CommitReady(EEPROM_Handle *handle);
+static bool EEPROM_ClaimBus(EEPROM_Handle *handle, uint8_t chip);
+static void EEPROM_StartJob(EEPROM_Handle *handle, uint8_t chip);
+static void EEPROM_SendJob(EEPROM_Handle *handle, uint8_t chip);
+static void EEPROM_FinishJob(EEPROM_Handle *handle, uint8_t chip);
+static void EEPROM_PollJob(EEPROM_Handle *handle, uint8_t chip, uint32_t now);
+static bool EEPROM_BusOwned(EEPROM_Handle *handle);
+static uint32_t EEPROM_ReadAvailable(EEPROM_Handle *handle);
+static HAL_StatusTypeDef EEPROM_StreamSegment(EEPROM_Handle *handle);
+static void EEPROM_StreamNextFrame(EEPROM_Handle *handle);
+static void EEPROM_StreamDeliver(EEPROM_Handle *handle, const uint8_t *buf, uint16_t len);
+static void EEPROM_StreamFinish(EEPROM_Handle *handle, HAL_StatusTypeDef status);
+static uint16_t EEPROM_IterSpan(EEPROM_Iterator *it, uint16_t want, uint16_t space, uint16_t *raw);
+static HAL_StatusTypeDef EEPROM_IterRead(I2C_HandleTypeDef *hi2c, EEPROM_Iterator *it, uint8_t *data, uint16_t got, uint16_t raw);
 
 /*
  * @brief waits for write completion
- * @param hi2c pointer to the I@C handle
+ * @param[1] hi2c pointer to the I@C handle
+ * @param[2] I2C address of the chip written
  * @retvat HAL_Status
  *
  * */
-static HAL_StatusTypeDef EEPROM_WaitForWriteCompletion(I2C_HandleTypeDef *hi2c)
+static HAL_StatusTypeDef EEPROM_WaitForWriteCompletion(I2C_HandleTypeDef *hi2c, uint16_t dev)
 {
     uint32_t startTick = HAL_GetTick();
-    while (HAL_I2C_IsDeviceReady(hi2c, EEPROM_I2C_ADDR, 1, 10) != HAL_OK)
+    while (HAL_I2C_IsDeviceReady(hi2c, dev, 1, 10) != HAL_OK)
     {
         if ((HAL_GetTick() - startTick) > EEPROM_ACK_TIMEOUT_MS)
             return HAL_TIMEOUT;
@@ -29,6 +76,62 @@ static HAL_StatusTypeDef EEPROM_WaitForWriteCompletion(I2C_HandleTypeDef *hi2c)
     return HAL_OK;
 }
 
+/*
+ * @brief Address of the first byte (header) of a data block on its chip
+ * @param block index
+ * @retval EEPROM address
+ *
+ * */
+static uint16_t EEPROM_BlockAddr(uint16_t block)
+{
+    return EEPROM_DATA_START_ADDR + (block / EEPROM_CHIP_COUNT) * EEPROM_PAGE_SIZE;
+}
+
+/*
+ * @brief Chip holding a data block, consecutive blocks are striped over the chips
+ * @param block index
+ * @retval chip index
+ *
+ * */
+static uint8_t EEPROM_BlockChip(uint16_t block)
+{
+    return block % EEPROM_CHIP_COUNT;
+}
+
+/*
+ * @brief I2C address of the chip holding a data block
+ * @param block index
+ * @retval I2C address
+ *
+ * */
+static uint16_t EEPROM_BlockDev(uint16_t block)
+{
+    return EEPROM_CHIP_ADDR(EEPROM_BlockChip(block));
+}
+
+/*
+ * @brief Block holding an address of the data ring of a chip
+ * @param[1] chip index
+ * @param[2] EEPROM address
+ * @retval block index
+ *
+ * */
+static uint16_t EEPROM_PhysBlock(uint8_t chip, uint16_t addr)
+{
+    return ((addr - EEPROM_DATA_START_ADDR) / EEPROM_PAGE_SIZE) * EEPROM_CHIP_COUNT + chip;
+}
+
+/*
+ * @brief Next block in the ring
+ * @param block index
+ * @retval block index
+ *
+ * */
+static uint16_t EEPROM_BlockNext(uint16_t block)
+{
+    return (block + 1 < EEPROM_BLOCK_COUNT) ? block + 1 : 0;
+}
+
 /*
  * @brief Checks the EEPROM status and Initializes the EEPROM with meta data read from the reserved memory
  * @param[1] hi2c pointer to the I2C handle
@@ -38,12 +141,21 @@ static HAL_StatusTypeDef EEPROM_WaitForWriteCompletion(I2C_HandleTypeDef *hi2c)
  * */
 HAL_StatusTypeDef EEPROM_Init(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle)
 {
+    handle->hi2c = hi2c;
     handle->status = EEPROM_CheckStatus(hi2c);
     handle->state = EEPROM_IDLE;
-    handle->write_ptr = EEPROM_DATA_START_ADDR;
-    handle->read_ptr = EEPROM_DATA_START_ADDR;
-    handle->used_size = 0;
-    handle->has_wrapped = false;
+    handle->write_status = HAL_OK;
+    handle->stream_active = false;
+    handle->job_bus = EEPROM_CHIP_COUNT;
+    handle->meta_seq = 0;
+    handle->meta_slot = EEPROM_JOURNAL_SLOTS - 1;  // first store goes to slot 0
+    handle->generation = 0;
+    handle->stage_writes = 0;
+    handle->stage_tick = 0;
+    handle->stage_buf = handle->stage_pages[0];
+    handle->flush_mode = EEPROM_FLUSH_ON_DEMAND;
+    handle->flush_param = 0;
+    EEPROM_ResetLog(handle, 0, 0);
     if(EEPROM_RestoreMetadata(hi2c, handle) != HAL_OK){
     	return HAL_ERROR;
     }
@@ -53,245 +165,1984 @@ HAL_StatusTypeDef EEPROM_Init(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle)
 /*
  * @brief Checks the EEPROM Status if its present on the I2C bus or not
  * @param hi2c pointer to the I2C handle
- * @retval EEPROM Status
+ * @retval EEPROM Status, present only if every chip of the array answers
  *
  * */
 EEPROM_Status EEPROM_CheckStatus(I2C_HandleTypeDef *hi2c)
 {
-    if (HAL_I2C_IsDeviceReady(hi2c, EEPROM_I2C_ADDR, 3, 100) == HAL_OK)
-        return EEPROM_STATUS_PRESENT;
-    return EEPROM_STATUS_NOT_PRESENT;
+    for (uint8_t chip = 0; chip < EEPROM_CHIP_COUNT; chip++) {
+        if (HAL_I2C_IsDeviceReady(hi2c, EEPROM_CHIP_ADDR(chip), 3, 100) != HAL_OK)
+            return EEPROM_STATUS_NOT_PRESENT;
+    }
+    return EEPROM_STATUS_PRESENT;
 }
 
 /*
  * @brief checks the EEPROM status if its busy or not
  * @param EEPROM Handle
- * @retval weather the EEPROM is busy or in bool
+ * @retval weather the EEPROM is busy or in bool, includes a page write still in flight
  *
  * */
 bool EEPROM_IsBusy(EEPROM_Handle *handle)
 {
-    return (handle->state == EEPROM_BUSY);
+    return (handle->state == EEPROM_BUSY) || EEPROM_BusOwned(handle);
 }
 
 /*
- * @brief Restores the meta data from the reserved memory
+ * @brief CRC-8 (poly 0x07) used to reject torn or blank journal records and block headers
+ * @param[1] data to be checked
+ * @param[2] length of data
+ * @retval crc
+ *
+ * */
+static uint8_t EEPROM_Crc8(const uint8_t *data, uint8_t len)
+{
+    uint8_t crc = 0;
+    while (len--) {
+        crc ^= *data++;
+        for (uint8_t bit = 0; bit < 8; bit++)
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+/*
+ * @brief Fills in a block header
+ * @param[1] header bytes
+ * @param[2] sequence number of the block
+ * @param[3] data bytes in the block
+ * @retval void
+ *
+ * */
+static void EEPROM_PackHeader(uint8_t *hdr, uint16_t seq, uint8_t fill)
+{
+    hdr[0] = (seq >> 8);
+    hdr[1] = (seq & 0xFF);
+    hdr[2] = fill;
+    hdr[3] = EEPROM_Crc8(hdr, EEPROM_BLOCK_HDR_SIZE - 1);
+}
+
+/*
+ * @brief Reads and checks a block header
  * @param[1] hi2c pointer to the I2C handle
- * @param[2] EEPROM structure pointer
- * @retval HAL_Status
+ * @param[2] I2C address of the chip
+ * @param[3] EEPROM address of the block
+ * @param[4] sequence number of the block
+ * @param[5] data bytes in the block
+ * @param[6] false for blank, torn or stale layout 1 data
+ * @retval HAL_Status of the bus transfer
  *
  * */
-HAL_StatusTypeDef EEPROM_RestoreMetadata(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle)
+static HAL_StatusTypeDef EEPROM_ReadHeader(I2C_HandleTypeDef *hi2c, uint16_t dev, uint16_t addr, uint16_t *seq, uint8_t *fill, bool *valid)
 {
-    uint8_t meta[5]; //left one address willingly empty for future addition
-    if (HAL_I2C_Mem_Read(hi2c, EEPROM_I2C_ADDR, EEPROM_PTR_META_ADDR, I2C_MEMADD_SIZE_16BIT, meta, 5, HAL_MAX_DELAY) != HAL_OK)
+    uint8_t hdr[EEPROM_BLOCK_HDR_SIZE];
+    if (HAL_I2C_Mem_Read(hi2c, dev, addr, I2C_MEMADD_SIZE_16BIT, hdr, EEPROM_BLOCK_HDR_SIZE, HAL_MAX_DELAY) != HAL_OK)
         return HAL_ERROR;
 
-    handle->write_ptr = (meta[0] << 8) | meta[1];
-    handle->used_size = (meta[2] << 8) | meta[3];
-    handle->has_wrapped = (meta[4] != 0);
+    *seq = (hdr[0] << 8) | hdr[1];
+    *fill = hdr[2];
+    *valid = (EEPROM_Crc8(hdr, EEPROM_BLOCK_HDR_SIZE - 1) == hdr[3]) && (hdr[2] <= EEPROM_BLOCK_PAYLOAD);
+    return HAL_OK;
+}
 
-    if (handle->write_ptr < EEPROM_DATA_START_ADDR || handle->write_ptr >= EEPROM_TOTAL_SIZE)
-        handle->write_ptr = EEPROM_DATA_START_ADDR;
+/*
+ * @brief Reads bytes of the layout 1 byte ring by offset from EEPROM_LEGACY_START_ADDR, wrapping at the ring end
+ * @param[1] hi2c pointer to the I2C handle
+ * @param[2] ring offset, may be past the ring size
+ * @param[3] data to be read
+ * @param[4] size of data to be read
+ * @retval HAL_Status
+ *
+ * */
+static HAL_StatusTypeDef EEPROM_ReadLegacyRing(I2C_HandleTypeDef *hi2c, uint32_t offset, uint8_t *data, uint16_t size)
+{
+    offset %= EEPROM_LEGACY_RING_SIZE;
+    uint16_t first = EEPROM_LEGACY_RING_SIZE - offset;
+    if (first > size)
+        first = size;
 
+    if (HAL_I2C_Mem_Read(hi2c, EEPROM_I2C_ADDR, EEPROM_LEGACY_START_ADDR + offset, I2C_MEMADD_SIZE_16BIT, data, first, HAL_MAX_DELAY) != HAL_OK)
+        return HAL_ERROR;
+    if (first < size &&
+        HAL_I2C_Mem_Read(hi2c, EEPROM_I2C_ADDR, EEPROM_LEGACY_START_ADDR, I2C_MEMADD_SIZE_16BIT, data + first, size - first, HAL_MAX_DELAY) != HAL_OK)
+        return HAL_ERROR;
     return HAL_OK;
 }
 
 /*
- * @brief Stores the Meta data into the reserved memory after each read and write
- * @param[1] hi2c pointer to the I2C handle
- * @param[2] EEPROM structure pointer
+ * @brief Starts an empty log whose first block will be written at block with sequence number seq
+ * @param[1] EEPROM structure pointer
+ * @param[2] first block of the log
+ * @param[3] sequence number of the first block
  * @retval void
  *
  * */
-void EEPROM_StoreMetadata(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle)
+static void EEPROM_ResetLog(EEPROM_Handle *handle, uint16_t block, uint16_t seq)
 {
-    uint8_t meta[5];
-    meta[0] = (handle->write_ptr >> 8);
-    meta[1] = (handle->write_ptr & 0xFF);
-    meta[2] = (handle->used_size >> 8);
-    meta[3] = (handle->used_size & 0xFF);
-    meta[4] = handle->has_wrapped ? 1 : 0;
-
-    HAL_I2C_Mem_Write(hi2c, EEPROM_I2C_ADDR, EEPROM_PTR_META_ADDR, I2C_MEMADD_SIZE_16BIT, meta, 5, HAL_MAX_DELAY);
-    EEPROM_WaitForWriteCompletion(hi2c);
+    handle->head_block = block;
+    handle->head_seq = seq;
+    handle->head_fill = 0;
+    handle->anchor_block = block;
+    handle->anchor_seq = seq;
+    handle->floor_seq = seq;
+    handle->lap_pending = false;
+    handle->has_wrapped = false;
+    handle->stage_len = 0;
+    handle->stage_sent = 0;
+    handle->stage_writes = 0;
+    for (uint8_t chip = 0; chip < EEPROM_CHIP_COUNT; chip++)
+        handle->job[chip].phase = EEPROM_JOB_IDLE;   // a failed page of the old log is dropped
+    EEPROM_UpdatePointers(handle);
+    handle->read_ptr = handle->write_ptr;
 }
 
 /*
- * @brief Erases the EEPROM to the length specified
+ * @brief Reads the pointers from the legacy 5 byte block written by older firmware and converts that log
  * @param[1] hi2c pointer to the I2C handle
  * @param[2] EEPROM structure pointer
- * @param[3] Start address from there erase has to start
- * @param[4] length of data to be erased
- * @retval void
+ * @retval HAL_Status
  *
  * */
-void EEPROM_Erase(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle, uint16_t start_addr, uint16_t length)
+static HAL_StatusTypeDef EEPROM_RestoreLegacyMetadata(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle)
 {
-    if (handle->status != EEPROM_STATUS_PRESENT || handle->state == EEPROM_BUSY)
-        return;
+    uint8_t meta[5]; //left one address willingly empty for future addition
+    if (HAL_I2C_Mem_Read(hi2c, EEPROM_I2C_ADDR, EEPROM_PTR_META_ADDR, I2C_MEMADD_SIZE_16BIT, meta, 5, HAL_MAX_DELAY) != HAL_OK)
+        return HAL_ERROR;
 
-    handle->state = EEPROM_BUSY;
+    uint16_t write_ptr = (meta[0] << 8) | meta[1];
+    bool has_wrapped = (meta[4] != 0);
 
-    uint8_t blank[EEPROM_PAGE_SIZE];
-    memset(blank, 0xFF, EEPROM_PAGE_SIZE);
+    if (write_ptr < EEPROM_LEGACY_START_ADDR || write_ptr > EEPROM_TOTAL_SIZE) {
+        // blank or corrupt block, start a new log
+        write_ptr = EEPROM_LEGACY_START_ADDR;
+        has_wrapped = false;
+    }
+    else if (write_ptr >= EEPROM_DATA_END_ADDR) {
+        // the journal owns the last pages, the ring is full up to its end
+        write_ptr = EEPROM_DATA_END_ADDR;
+    }
 
-    uint16_t addr = start_addr;
-    while (length > 0)
-    {
-        uint16_t chunk = (length > EEPROM_PAGE_SIZE) ? EEPROM_PAGE_SIZE : length;
+    return EEPROM_ConvertLegacyLog(hi2c, handle, write_ptr, has_wrapped);
+}
+
+/*
+ * @brief Converts a layout 1 byte ring into sequence stamped blocks in place.
+ *        Blocks are rebuilt newest first into the space behind the newest byte. Every block gives
+ *        EEPROM_BLOCK_HDR_SIZE bytes of that head room away (and the meta data page once), so
+ *        EEPROM_LEGACY_GAP keeps the writes ahead of the unread data; the oldest bytes are dropped
+ *        when the ring is too full. Runs once, the power has to stay on for the ~2.5 s it takes on a full ring.
+ * @param[1] hi2c pointer to the I2C handle
+ * @param[2] EEPROM structure pointer
+ * @param[3] layout 1 write pointer
+ * @param[4] layout 1 wrap flag
+ * @retval HAL_Status
+ *
+ * */
+static HAL_StatusTypeDef EEPROM_ConvertLegacyLog(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle, uint16_t write_ptr, bool has_wrapped)
+{
+    if (EEPROM_CHIP_COUNT > 1) {
+        // the old log sits on chip 0 only, an array starts empty
+        EEPROM_ResetLog(handle, 0, 0);
+        return EEPROM_StoreMetadata(hi2c, handle);
+    }
 
-        uint8_t buffer[chunk + 2];
-        buffer[0] = (addr >> 8) & 0xFF;
-        buffer[1] = addr & 0xFF;
-        memcpy(&buffer[2], blank, chunk);
+    uint32_t oldest = has_wrapped ? (uint32_t)(write_ptr - EEPROM_LEGACY_START_ADDR) % EEPROM_LEGACY_RING_SIZE : 0;
+    uint32_t length = has_wrapped ? EEPROM_LEGACY_RING_SIZE : (uint32_t)(write_ptr - EEPROM_LEGACY_START_ADDR);
+    uint32_t src = oldest + length;     // layout 1 ring offsets, counted past the ring end instead of wrapping
 
-        HAL_I2C_Master_Transmit(hi2c, EEPROM_I2C_ADDR, buffer, chunk + 2, HAL_MAX_DELAY);
-        EEPROM_WaitForWriteCompletion(hi2c);
+    // first block end at least EEPROM_LEGACY_GAP after the newest byte
+    uint32_t dst = src + EEPROM_LEGACY_GAP;
+    uint16_t addr = EEPROM_LEGACY_START_ADDR + dst % EEPROM_LEGACY_RING_SIZE;
+    uint16_t end = (addr + EEPROM_PAGE_SIZE - 1) & ~(EEPROM_PAGE_SIZE - 1);
+    if (end < EEPROM_BlockAddr(1))
+        end = EEPROM_BlockAddr(1);   // the meta data page holds no block
+    dst += end - addr;
+    uint16_t top = EEPROM_PhysBlock(0, end) - 1;   // block that ends there
 
-        addr += chunk;
-        length -= chunk;
+    uint32_t keep = EEPROM_LEGACY_RING_SIZE - (dst - src);
+    if (keep > length)
+        keep = length;
+
+    if (keep == 0) {
+        EEPROM_ResetLog(handle, 0, 0);
+        return EEPROM_StoreMetadata(hi2c, handle);
     }
 
-    if (start_addr == EEPROM_DATA_START_ADDR) {
-        handle->write_ptr = EEPROM_DATA_START_ADDR;
-        handle->used_size = 0;
-        handle->has_wrapped = false;
-        EEPROM_StoreMetadata(hi2c, handle);
+    // only the newest block may be partially filled
+    uint16_t blocks = (keep + EEPROM_BLOCK_PAYLOAD - 1) / EEPROM_BLOCK_PAYLOAD;
+    uint16_t seq = blocks - 1;
+    uint8_t fill = keep - seq * EEPROM_BLOCK_PAYLOAD;
+    uint8_t *image = handle->stage_buf;
+    uint16_t block = top;
+    for (uint16_t i = 0; i < blocks; i++) {
+        if (EEPROM_ReadLegacyRing(hi2c, src - fill, &image[EEPROM_BLOCK_HDR_SIZE], fill) != HAL_OK)
+            return HAL_ERROR;
+        EEPROM_PackHeader(image, seq, fill);
+        if (EEPROM_WriteRaw(hi2c, EEPROM_I2C_ADDR, EEPROM_BlockAddr(block), image, EEPROM_BLOCK_HDR_SIZE + fill) != HAL_OK)
+            return HAL_ERROR;
+
+        src -= fill;
+        seq--;
+        if (i + 1 < blocks) {
+            block = (block == 0) ? EEPROM_BLOCK_COUNT - 1 : block - 1;
+            fill = EEPROM_BLOCK_PAYLOAD;
+        }
     }
 
-    handle->state = EEPROM_IDLE;
+    // oldest block written last becomes the anchor, the newest one is found by EEPROM_FindHead
+    EEPROM_ResetLog(handle, block, 0);
+    if (EEPROM_StoreMetadata(hi2c, handle) != HAL_OK)
+        return HAL_ERROR;
+    return EEPROM_FindHead(hi2c, handle);
 }
 
 /*
- * @brief Erases the EEPROM to the length specified
- * @param[1] hi2c pointer to the I2C handle
- * @param[2] EEPROM structure pointer
- * @param[3] Start address from there erase has to start
- * @param[4] length of data to be erased
- * @retval void
+ * @brief Address of a layout 2 block, block 0 was the partial page behind the legacy block
+ * @param layout 2 block index
+ * @retval EEPROM address
  *
  * */
-void EEPROM_EraseAll(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle)
+static uint16_t EEPROM_Layout2Addr(uint16_t block)
 {
-    EEPROM_Erase(hi2c, handle, EEPROM_DATA_START_ADDR, EEPROM_TOTAL_SIZE - EEPROM_DATA_START_ADDR);
+    return (block == 0) ? EEPROM_LEGACY_START_ADDR : block * EEPROM_PAGE_SIZE;
 }
 
 /*
- * @brief Writes the number of Bytes passed
+ * @brief Moves a layout 2 log onto whole pages. Layout 2 blocks 1..507 already sit on the pages of
+ *        blocks 0..506, so a log that does not use the short block 0 is only renumbered. Otherwise block 0
+ *        and the blocks after it are repacked page by page, every page is read before it is rewritten;
+ *        the oldest block is dropped if the repacked log no longer fits.
+ *        Runs once, the power has to stay on while pages are repacked.
  * @param[1] hi2c pointer to the I2C handle
- * @param[2] EEPROM structure pointer
- * @param[3] data to be written
- * @param[4] size of data to be written
+ * @param[2] EEPROM structure pointer, layout 2 anchor and floor already restored
  * @retval HAL_Status
  *
  * */
-HAL_StatusTypeDef EEPROM_WriteBytes(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle, uint8_t *data, uint16_t size)
+static HAL_StatusTypeDef EEPROM_MigrateLayout2(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle)
 {
-    if (handle->status != EEPROM_STATUS_PRESENT || handle->state == EEPROM_BUSY)
-        return HAL_ERROR;
+    if (EEPROM_CHIP_COUNT > 1)
+        return EEPROM_AbandonLog(hi2c, handle);   // the old log sits on chip 0 only
 
-    handle->state = EEPROM_BUSY;
+    const uint16_t count = EEPROM_LAYOUT2_BLOCK_COUNT;
+    uint16_t anchor = handle->anchor_block;
+    uint16_t anchor_seq = handle->anchor_seq;
+    uint16_t seq;
+    uint8_t fill;
+    bool valid;
 
-    while (size > 0) {
-        if (handle->write_ptr >= EEPROM_TOTAL_SIZE) {
-            handle->write_ptr = EEPROM_DATA_START_ADDR;
-            handle->has_wrapped = true;
+    // same search as EEPROM_FindHead over the layout 2 blocks
+    if (EEPROM_ReadHeader(hi2c, EEPROM_I2C_ADDR, EEPROM_Layout2Addr(anchor), &seq, &fill, &valid) != HAL_OK)
+        return HAL_ERROR;
+    bool empty = false;
+    if (valid && seq == (uint16_t)(anchor_seq + count)) {
+        anchor_seq = seq;
+    }
+    else if (!valid || seq != anchor_seq) {
+        uint16_t next = (anchor + 1) % count;
+        if (EEPROM_ReadHeader(hi2c, EEPROM_I2C_ADDR, EEPROM_Layout2Addr(next), &seq, &fill, &valid) != HAL_OK)
+            return HAL_ERROR;
+        empty = !valid || seq != (uint16_t)(anchor_seq + 1);
+        if (!empty) {
+            anchor = next;
+            anchor_seq = seq;
         }
+    }
 
-        uint16_t page_offset = handle->write_ptr % EEPROM_PAGE_SIZE;
-        uint16_t space_in_page = EEPROM_PAGE_SIZE - page_offset;
-        uint16_t chunk_size = (size < space_in_page) ? size : space_in_page;
-
-        uint8_t buffer[chunk_size + 2];
-        buffer[0] = (handle->write_ptr >> 8) & 0xFF;
-        buffer[1] = handle->write_ptr & 0xFF;
-        memcpy(&buffer[2], data, chunk_size);
-
-        if (HAL_I2C_Master_Transmit(hi2c, EEPROM_I2C_ADDR, buffer, chunk_size + 2, HAL_MAX_DELAY) != HAL_OK) {
-            handle->state = EEPROM_IDLE;
+    uint16_t oldest = anchor;
+    uint16_t oldest_seq = anchor_seq;
+    uint16_t blocks = 0;
+    uint16_t head = anchor;
+    uint8_t head_fill = 0;
+    if (!empty) {
+        uint16_t lo = 0;
+        uint16_t hi = count - 1;
+        while (lo < hi) {
+            uint16_t mid = lo + (hi - lo + 1) / 2;
+            if (EEPROM_ReadHeader(hi2c, EEPROM_I2C_ADDR, EEPROM_Layout2Addr((anchor + mid) % count), &seq, &fill, &valid) != HAL_OK)
+                return HAL_ERROR;
+            if (valid && seq == (uint16_t)(anchor_seq + mid))
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+        head = (anchor + lo) % count;
+        if (EEPROM_ReadHeader(hi2c, EEPROM_I2C_ADDR, EEPROM_Layout2Addr(head), &seq, &head_fill, &valid) != HAL_OK)
             return HAL_ERROR;
+
+        bool wrapped = (lo == count - 1);
+        if (!wrapped) {
+            if (EEPROM_ReadHeader(hi2c, EEPROM_I2C_ADDR, EEPROM_Layout2Addr((head + 1) % count), &seq, &fill, &valid) != HAL_OK)
+                return HAL_ERROR;
+            wrapped = valid && seq == (uint16_t)(anchor_seq + lo + 1 - count)
+                      && (int16_t)(seq - handle->floor_seq) >= 0;
         }
+        blocks = wrapped ? count : lo + 1;
+        if (wrapped) {
+            oldest = (head + 1) % count;
+            oldest_seq = anchor_seq + lo + 1 - count;
+        }
+    }
 
-        if (EEPROM_WaitForWriteCompletion(hi2c) != HAL_OK) {
-                    handle->state = EEPROM_IDLE;
-                    return HAL_TIMEOUT;
+    if (empty || (oldest != 0 && oldest + blocks <= count) || (oldest == 0 && blocks == count)) {
+        // block 0 is not part of the log, or it is the oldest block of a full ring and dropped
+        if (oldest == 0 && !empty) {
+            oldest = 1;
+            oldest_seq++;
         }
+        EEPROM_ResetLog(handle, (oldest == 0) ? 0 : oldest - 1, oldest_seq);
+    }
+    else {
+        uint16_t older = (oldest == 0) ? 0 : count - oldest;   // blocks in front of block 0, they stay in place
+        uint8_t carry[2 * EEPROM_PAGE_SIZE];
+        uint8_t have = (head == 0) ? head_fill : EEPROM_PAGE_SIZE - EEPROM_LEGACY_START_ADDR - EEPROM_BLOCK_HDR_SIZE;
+        uint16_t total = (head == 0) ? head_fill : have + (head - 1) * EEPROM_BLOCK_PAYLOAD + head_fill;
+        uint16_t repacked = (total + EEPROM_BLOCK_PAYLOAD - 1) / EEPROM_BLOCK_PAYLOAD;
+
+        if (HAL_I2C_Mem_Read(hi2c, EEPROM_I2C_ADDR, EEPROM_LEGACY_START_ADDR + EEPROM_BLOCK_HDR_SIZE, I2C_MEMADD_SIZE_16BIT,
+                             carry, have, HAL_MAX_DELAY) != HAL_OK)
+            return HAL_ERROR;
+
+        uint8_t hdr[EEPROM_BLOCK_HDR_SIZE];
+        uint16_t src = 1;
+        for (uint16_t k = 0; k < repacked; k++) {
+            if (have < EEPROM_BLOCK_PAYLOAD && src <= head) {
+                // block k goes to the page of layout 2 block src
+                uint8_t n = (src == head) ? head_fill : EEPROM_BLOCK_PAYLOAD;
+                if (HAL_I2C_Mem_Read(hi2c, EEPROM_I2C_ADDR, EEPROM_Layout2Addr(src) + EEPROM_BLOCK_HDR_SIZE, I2C_MEMADD_SIZE_16BIT,
+                                     &carry[have], n, HAL_MAX_DELAY) != HAL_OK)
+                    return HAL_ERROR;
+                have += n;
+                src++;
+            }
 
-        handle->write_ptr += chunk_size;
-        handle->used_size += chunk_size;
-        if (handle->used_size > EEPROM_MAX_USABLE_SIZE) {
-            handle->used_size = EEPROM_MAX_USABLE_SIZE;
-            handle->has_wrapped = true;
+            uint8_t out = (have < EEPROM_BLOCK_PAYLOAD) ? have : EEPROM_BLOCK_PAYLOAD;
+            EEPROM_PackHeader(hdr, oldest_seq + older + k, out);
+            EEPROM_Segment seg[2] = {
+                { hdr, EEPROM_BLOCK_HDR_SIZE },
+                { carry, out }
+            };
+            if (EEPROM_WriteSegments(hi2c, EEPROM_I2C_ADDR, EEPROM_BlockAddr(k), seg, 2) != HAL_OK)
+                return HAL_ERROR;
+            have -= out;
+            memmove(carry, &carry[out], have);
         }
 
-        data += chunk_size;
-        size -= chunk_size;
+        if (older > 0 && older + repacked > EEPROM_BLOCK_COUNT) {
+            // the last repacked block took the page of the oldest one
+            oldest = (oldest + 1) % count;
+            oldest_seq++;
+            older--;
+        }
+        EEPROM_ResetLog(handle, (older == 0) ? 0 : oldest - 1, oldest_seq);
     }
 
-    EEPROM_StoreMetadata(hi2c, handle);
-    handle->state = EEPROM_IDLE;
-    return HAL_OK;
+    if (EEPROM_StoreMetadata(hi2c, handle) != HAL_OK)
+        return HAL_ERROR;
+
+    // the meta data page keeps no data, a lost journal then reads as a blank legacy block
+    memset(handle->stage_buf, 0xFF, EEPROM_PAGE_SIZE);
+    if (EEPROM_WriteRaw(hi2c, EEPROM_I2C_ADDR, EEPROM_PTR_META_ADDR, handle->stage_buf, EEPROM_PAGE_SIZE) != HAL_OK)
+        return HAL_ERROR;
+    return EEPROM_FindHead(hi2c, handle);
 }
 
 /*
- * @brief Reads the number of Bytes passed
+ * @brief Rebuilds head, write pointer, used size and wrap flag by binary searching the block sequence
+ *        numbers from the anchor. Costs log2(EEPROM_BLOCK_COUNT) + 3 header/page reads,
+ *        plus 2 * (EEPROM_CHIP_COUNT - 1) for an array.
  * @param[1] hi2c pointer to the I2C handle
- * @param[2] EEPROM structure pointer
- * @param[3] data to be read
- * @param[4] size of data to be read
+ * @param[2] EEPROM structure pointer, anchor and floor already restored
  * @retval HAL_Status
  *
  * */
-HAL_StatusTypeDef EEPROM_ReadBytes(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle, uint8_t *data, uint16_t size)
+static HAL_StatusTypeDef EEPROM_FindHead(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle)
 {
-    if (handle->status != EEPROM_STATUS_PRESENT || handle->state == EEPROM_BUSY)
+    uint16_t anchor = handle->anchor_block;
+    uint16_t anchor_seq = handle->anchor_seq;
+    uint16_t seq;
+    uint8_t fill;
+    bool valid;
+
+    if (EEPROM_ReadHeader(hi2c, EEPROM_BlockDev(anchor), EEPROM_BlockAddr(anchor), &seq, &fill, &valid) != HAL_OK)
         return HAL_ERROR;
 
-    handle->state = EEPROM_BUSY;
+    if (valid && seq == (uint16_t)(anchor_seq + EEPROM_BLOCK_COUNT)) {
+        // head started a new lap on the anchor but the journal was not updated yet
+        anchor_seq = seq;
+        handle->lap_pending = true;
+    }
+    else if (!valid || seq != anchor_seq) {
+        // anchor torn while starting a new lap, the block after it is the oldest one
+        uint16_t next = EEPROM_BlockNext(anchor);
+        if (EEPROM_ReadHeader(hi2c, EEPROM_BlockDev(next), EEPROM_BlockAddr(next), &seq, &fill, &valid) != HAL_OK)
+            return HAL_ERROR;
+        if (!valid || seq != (uint16_t)(anchor_seq + 1)) {
+            // nothing written since the log was started
+            EEPROM_ResetLog(handle, anchor, anchor_seq);
+            return HAL_OK;
+        }
+        anchor = next;
+        anchor_seq = seq;
+    }
 
-    uint16_t remaining = size;
-    uint8_t *ptr = data;
+    // blocks anchor..head carry consecutive sequence numbers, the one after the head does not
+    uint16_t lo = 0;
+    uint16_t hi = EEPROM_BLOCK_COUNT - 1;
+    while (lo < hi) {
+        uint16_t mid = lo + (hi - lo + 1) / 2;
+        uint16_t block = (anchor + mid) % EEPROM_BLOCK_COUNT;
+        if (EEPROM_ReadHeader(hi2c, EEPROM_BlockDev(block), EEPROM_BlockAddr(block), &seq, &fill, &valid) != HAL_OK)
+            return HAL_ERROR;
+        if (valid && seq == (uint16_t)(anchor_seq + mid))
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    if (EEPROM_TrimHead(hi2c, anchor, anchor_seq, &lo) != HAL_OK)
+        return HAL_ERROR;
 
-    // Calculate how much can be read
-    uint16_t available = handle->has_wrapped ? EEPROM_MAX_USABLE_SIZE : (handle->write_ptr - handle->read_ptr);
+    handle->head_block = (anchor + lo) % EEPROM_BLOCK_COUNT;
+    handle->head_seq = anchor_seq + lo;
 
-    if (size > available) {
-        handle->state = EEPROM_IDLE;
-        return HAL_ERROR;  // Trying to read more than available
+    // the head image is kept in RAM so further data can be appended to it
+    uint8_t *image = handle->stage_buf;
+    if (HAL_I2C_Mem_Read(hi2c, EEPROM_BlockDev(handle->head_block), EEPROM_BlockAddr(handle->head_block), I2C_MEMADD_SIZE_16BIT,
+                         image, EEPROM_BLOCK_HDR_SIZE + EEPROM_BLOCK_PAYLOAD, HAL_MAX_DELAY) != HAL_OK)
+        return HAL_ERROR;
+    handle->head_fill = image[2];
+    handle->stage_len = image[2];
+    handle->stage_sent = image[2];
+
+    // wrapped if the block after the head belongs to the previous lap of this log
+    handle->has_wrapped = (lo == EEPROM_BLOCK_COUNT - 1);
+    if (!handle->has_wrapped) {
+        uint16_t next = EEPROM_BlockNext(handle->head_block);
+        if (EEPROM_ReadHeader(hi2c, EEPROM_BlockDev(next), EEPROM_BlockAddr(next), &seq, &fill, &valid) != HAL_OK)
+            return HAL_ERROR;
+        handle->has_wrapped = valid && seq == (uint16_t)(handle->head_seq + 1 - EEPROM_BLOCK_COUNT)
+                              && (int16_t)(seq - handle->floor_seq) >= 0;
     }
 
-    while (remaining > 0) {
-        if (handle->read_ptr >= EEPROM_TOTAL_SIZE)
-            handle->read_ptr = EEPROM_DATA_START_ADDR;
+    bool anchor_moved = (anchor != handle->anchor_block);
+    handle->anchor_block = anchor;
+    handle->anchor_seq = anchor_seq;
+    EEPROM_UpdatePointers(handle);
 
-        uint16_t chunk = EEPROM_PAGE_SIZE;
-        uint16_t to_page_end = EEPROM_PAGE_SIZE - (handle->read_ptr % EEPROM_PAGE_SIZE);
-        if (remaining < chunk) chunk = remaining;
-        if (chunk > to_page_end) chunk = to_page_end;
+    uint16_t oldest = handle->has_wrapped ? EEPROM_BlockNext(handle->head_block) : anchor;
+    handle->read_ptr = (uint32_t)oldest * EEPROM_PAGE_SIZE + EEPROM_BLOCK_HDR_SIZE;
 
-        uint8_t addr_bytes[2] = {
-            (uint8_t)(handle->read_ptr >> 8),
-            (uint8_t)(handle->read_ptr & 0xFF)
-        };
+    if (handle->lap_pending || anchor_moved) {
+        return EEPROM_StoreAnchor(hi2c, handle);
+    }
+    return HAL_OK;
+}
 
-        if (HAL_I2C_Master_Transmit(hi2c, EEPROM_I2C_ADDR, addr_bytes, 2, HAL_MAX_DELAY) != HAL_OK) {
-            handle->state = EEPROM_IDLE;
+/*
+ * @brief The chips of an array run their write cycles side by side, so a power loss can leave a block
+ *        missing with up to EEPROM_CHIP_COUNT - 1 later ones written. The head search may end on either
+ *        side of them. The head is moved back to the block before the gap, and the gap and the blocks
+ *        written behind it get their header blanked, they must not match a later head search.
+ *        The gap may still hold a block of the previous lap, blanking it ends a wrapped log at the head,
+ *        so the rest of the previous lap is given up.
+ * @param[1] hi2c pointer to the I2C handle
+ * @param[2] anchor block of the search
+ * @param[3] sequence number of the anchor block
+ * @param[4] head found by the search as offset from the anchor, moved back over a gap
+ * @retval HAL_Status
+ *
+ * */
+static HAL_StatusTypeDef EEPROM_TrimHead(I2C_HandleTypeDef *hi2c, uint16_t anchor, uint16_t anchor_seq, uint16_t *lo)
+{
+    uint16_t back = EEPROM_CHIP_COUNT - 1;   // a stripe wide at most, none on a single chip
+    if (back > *lo)
+        back = *lo;
+    uint16_t seq;
+    uint8_t fill;
+    bool valid;
+
+    // a gap in front of the head found, oldest first
+    for (; back > 0; back--) {
+        uint16_t block = (anchor + *lo - back) % EEPROM_BLOCK_COUNT;
+        if (EEPROM_ReadHeader(hi2c, EEPROM_BlockDev(block), EEPROM_BlockAddr(block), &seq, &fill, &valid) != HAL_OK)
             return HAL_ERROR;
-        }
+        if (!valid || seq != (uint16_t)(anchor_seq + *lo - back))
+            break;
+    }
+    if (back > 0)
+        *lo -= back + 1;
 
-        if (HAL_I2C_Master_Receive(hi2c, EEPROM_I2C_ADDR, ptr, chunk, HAL_MAX_DELAY) != HAL_OK) {
-            handle->state = EEPROM_IDLE;
+    // blocks written behind the gap after the head
+    uint16_t last = 0;
+    for (uint16_t k = 2; k <= EEPROM_CHIP_COUNT && *lo + k < EEPROM_BLOCK_COUNT; k++) {
+        uint16_t block = (anchor + *lo + k) % EEPROM_BLOCK_COUNT;
+        if (EEPROM_ReadHeader(hi2c, EEPROM_BlockDev(block), EEPROM_BlockAddr(block), &seq, &fill, &valid) != HAL_OK)
+            return HAL_ERROR;
+        if (valid && seq == (uint16_t)(anchor_seq + *lo + k))
+            last = k;
+    }
+
+    uint8_t blank[EEPROM_BLOCK_HDR_SIZE];
+    memset(blank, 0xFF, sizeof(blank));   // fill 0xFF never passes the header check
+    for (uint16_t k = 1; k <= last; k++) {
+        uint16_t block = (anchor + *lo + k) % EEPROM_BLOCK_COUNT;
+        if (EEPROM_WriteRaw(hi2c, EEPROM_BlockDev(block), EEPROM_BlockAddr(block), blank, sizeof(blank)) != HAL_OK)
             return HAL_ERROR;
+    }
+    return HAL_OK;
+}
+
+/*
+ * @brief Restores the log from the newest valid journal record, reads each journal page once.
+ *        Logs of layout 1 (or the legacy 5 byte block) and layout 2 are converted on the first boot.
+ * @param[1] hi2c pointer to the I2C handle
+ * @param[2] EEPROM structure pointer
+ * @retval HAL_Status
+ *
+ * */
+HAL_StatusTypeDef EEPROM_RestoreMetadata(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle)
+{
+    uint8_t page[EEPROM_PAGE_SIZE];
+    uint8_t newest[EEPROM_JOURNAL_RECORD_SIZE];
+    bool found = false;
+
+    for (uint8_t p = 0; p < EEPROM_JOURNAL_PAGES; p++) {
+        uint16_t page_addr = EEPROM_JOURNAL_ADDR + p * EEPROM_PAGE_SIZE;
+        if (HAL_I2C_Mem_Read(hi2c, EEPROM_I2C_ADDR, page_addr, I2C_MEMADD_SIZE_16BIT, page, EEPROM_PAGE_SIZE, HAL_MAX_DELAY) != HAL_OK)
+            return HAL_ERROR;
+
+        for (uint8_t r = 0; r < EEPROM_PAGE_SIZE / EEPROM_JOURNAL_RECORD_SIZE; r++) {
+            uint8_t *rec = &page[r * EEPROM_JOURNAL_RECORD_SIZE];
+            if (rec[0] != EEPROM_JOURNAL_MAGIC || rec[1] == 0 || rec[1] > EEPROM_LAYOUT_VERSION)
+                continue;
+            if (EEPROM_Crc8(rec, EEPROM_JOURNAL_RECORD_SIZE - 1) != rec[EEPROM_JOURNAL_RECORD_SIZE - 1])
+                continue;
+
+            uint32_t seq = ((uint32_t)rec[2] << 24) | ((uint32_t)rec[3] << 16) | ((uint32_t)rec[4] << 8) | rec[5];
+            if (found && (int32_t)(seq - handle->meta_seq) <= 0)
+                continue;
+
+            found = true;
+            handle->meta_seq = seq;
+            handle->meta_slot = p * (EEPROM_PAGE_SIZE / EEPROM_JOURNAL_RECORD_SIZE) + r;
+            memcpy(newest, rec, EEPROM_JOURNAL_RECORD_SIZE);
         }
+    }
 
-        handle->read_ptr += chunk;
-        ptr += chunk;
-        remaining -= chunk;
+    if (!found)
+        return EEPROM_RestoreLegacyMetadata(hi2c, handle);
+
+    if (newest[1] == 1) {
+        uint16_t write_ptr = (newest[6] << 8) | newest[7];
+        if (write_ptr < EEPROM_LEGACY_START_ADDR || write_ptr > EEPROM_DATA_END_ADDR)
+            write_ptr = EEPROM_LEGACY_START_ADDR;
+        return EEPROM_ConvertLegacyLog(hi2c, handle, write_ptr, (newest[10] & 0x01) != 0);
     }
 
-    handle->state = EEPROM_IDLE;
+    handle->anchor_block = (newest[6] << 8) | newest[7];
+    handle->anchor_seq = (newest[8] << 8) | newest[9];
+    handle->floor_seq = (newest[10] << 8) | newest[11];
+    handle->generation = (newest[12] << 8) | newest[13];
+    if (handle->generation == 0xFFFF)
+        handle->generation = 0;   // written before the generation was journaled
+
+    if (newest[1] == 2) {
+        handle->anchor_block %= EEPROM_LAYOUT2_BLOCK_COUNT;
+        return EEPROM_MigrateLayout2(hi2c, handle);
+    }
+    uint8_t chips = (newest[14] == 0xFF) ? 1 : newest[14];   // not journaled before arrays were supported
+    if (chips != EEPROM_CHIP_COUNT)
+        return EEPROM_AbandonLog(hi2c, handle);   // striped over another number of chips
+    handle->anchor_block %= EEPROM_BLOCK_COUNT;
+    return EEPROM_FindHead(hi2c, handle);
+}
+
+/*
+ * @brief Builds the journal record with the anchor of the log, it goes to the slot after meta_slot
+ * @param[1] EEPROM structure pointer
+ * @param[2] record of EEPROM_JOURNAL_RECORD_SIZE bytes
+ * @retval void
+ *
+ * */
+static void EEPROM_PackRecord(EEPROM_Handle *handle, uint8_t *rec)
+{
+    uint32_t seq = handle->meta_seq + 1;
+
+    memset(rec, 0xFF, EEPROM_JOURNAL_RECORD_SIZE);
+    rec[0] = EEPROM_JOURNAL_MAGIC;
+    rec[1] = EEPROM_LAYOUT_VERSION;
+    rec[2] = (seq >> 24);
+    rec[3] = (seq >> 16) & 0xFF;
+    rec[4] = (seq >> 8) & 0xFF;
+    rec[5] = seq & 0xFF;
+    rec[6] = (handle->anchor_block >> 8);
+    rec[7] = (handle->anchor_block & 0xFF);
+    rec[8] = (handle->anchor_seq >> 8);
+    rec[9] = (handle->anchor_seq & 0xFF);
+    rec[10] = (handle->floor_seq >> 8);
+    rec[11] = (handle->floor_seq & 0xFF);
+    rec[12] = (handle->generation >> 8);
+    rec[13] = (handle->generation & 0xFF);
+    rec[14] = EEPROM_CHIP_COUNT;
+    rec[EEPROM_JOURNAL_RECORD_SIZE - 1] = EEPROM_Crc8(rec, EEPROM_JOURNAL_RECORD_SIZE - 1);
+}
+
+/*
+ * @brief Appends a record with the anchor of the log to the next journal slot.
+ *        Only needed when the log is reset, converted or the head starts a new lap.
+ *        Blocking, bounded by EEPROM_ACK_TIMEOUT_MS for the transfer and again for the write cycle.
+ * @param[1] hi2c pointer to the I2C handle
+ * @param[2] EEPROM structure pointer
+ * @retval HAL_Status, HAL_BUSY while a page write or read is in flight; the slot is used again after an error
+ *
+ * */
+HAL_StatusTypeDef EEPROM_StoreMetadata(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle)
+{
+    uint8_t rec[EEPROM_JOURNAL_RECORD_SIZE];
+    uint8_t slot = (handle->meta_slot + 1) % EEPROM_JOURNAL_SLOTS;
+
+    if (EEPROM_BusOwned(handle))
+        return HAL_BUSY;
+
+    EEPROM_PackRecord(handle, rec);
+    uint16_t addr = EEPROM_JOURNAL_ADDR + slot * EEPROM_JOURNAL_RECORD_SIZE;
+    HAL_StatusTypeDef ret = HAL_I2C_Mem_Write(hi2c, EEPROM_I2C_ADDR, addr, I2C_MEMADD_SIZE_16BIT, rec, sizeof(rec), EEPROM_ACK_TIMEOUT_MS);
+    if (ret != HAL_OK)
+        return ret;
+    ret = EEPROM_WaitForWriteCompletion(hi2c, EEPROM_I2C_ADDR);
+    if (ret != HAL_OK)
+        return ret;
+
+    handle->meta_slot = slot;
+    handle->meta_seq++;
     return HAL_OK;
 }
 
+/*
+ * @brief Journals a moved anchor, the floor follows it so sequence comparisons stay within int16 reach
+ * @param[1] hi2c pointer to the I2C handle
+ * @param[2] EEPROM structure pointer
+ * @retval HAL_Status, the lap stays pending on an error
+ *
+ * */
+static HAL_StatusTypeDef EEPROM_StoreAnchor(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle)
+{
+    EEPROM_RaiseFloor(handle);
+    HAL_StatusTypeDef ret = EEPROM_StoreMetadata(hi2c, handle);
+    if (ret == HAL_OK)
+        handle->lap_pending = false;
+    return ret;
+}
+
+/*
+ * @brief Moves the floor up to one lap behind the anchor
+ * @param EEPROM structure pointer
+ * @retval void
+ *
+ * */
+static void EEPROM_RaiseFloor(EEPROM_Handle *handle)
+{
+    if ((int16_t)(handle->anchor_seq - EEPROM_BLOCK_COUNT - handle->floor_seq) > 0)
+        handle->floor_seq = handle->anchor_seq - EEPROM_BLOCK_COUNT;
+}
+
+/*
+ * @brief Starts a new, empty generation of the log at block. The sequence numbers continue above every
+ *        block already written and the floor is raised to the first of them, so the old blocks no longer
+ *        match the head search and are overwritten as the new log reaches them. Costs one journal write.
+ * @param[1] hi2c pointer to the I2C handle
+ * @param[2] EEPROM structure pointer
+ * @param[3] first block of the new log
+ * @retval HAL_Status of the journal write
+ *
+ * */
+static HAL_StatusTypeDef EEPROM_NewGeneration(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle, uint16_t block)
+{
+    handle->generation++;
+    EEPROM_ResetLog(handle, block, handle->head_seq + 1);   // staged bytes belong to the log being erased
+    return EEPROM_StoreMetadata(hi2c, handle);
+}
+
+/*
+ * @brief Starts a new generation in place of a log this build cannot read, e.g. one striped over another
+ *        number of chips. The sequence numbers jump past every block such a log can have written.
+ * @param[1] hi2c pointer to the I2C handle
+ * @param[2] EEPROM structure pointer, anchor of the old log restored
+ * @retval HAL_Status, HAL_ERROR if the journal could not be written
+ *
+ * */
+static HAL_StatusTypeDef EEPROM_AbandonLog(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle)
+{
+    handle->head_seq = handle->anchor_seq + 2 * EEPROM_MAX_CHIPS * EEPROM_CHIP_PAGES;
+    return (EEPROM_NewGeneration(hi2c, handle, 0) == HAL_OK) ? HAL_OK : HAL_ERROR;
+}
 
+/*
+ * @brief Erases the EEPROM to the length specified, the same range on every chip of the array
+ * @param[1] hi2c pointer to the I2C handle
+ * @param[2] EEPROM structure pointer
+ * @param[3] Start address from there erase has to start
+ * @param[4] length of data to be erased
+ * @retval HAL_Status, HAL_BUSY while a page write or read is in flight, else the first page write error
+ *
+ * */
+HAL_StatusTypeDef EEPROM_Erase(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle, uint16_t start_addr, uint16_t length)
+{
+    if (handle->status != EEPROM_STATUS_PRESENT)
+        return HAL_ERROR;
+    if (EEPROM_IsBusy(handle))
+        return HAL_BUSY;
+
+    handle->state = EEPROM_BUSY;
+
+    uint8_t blank[EEPROM_PAGE_SIZE];
+    memset(blank, 0xFF, EEPROM_PAGE_SIZE);
+
+    HAL_StatusTypeDef ret = HAL_OK;
+    for (uint8_t chip = 0; chip < EEPROM_CHIP_COUNT && ret == HAL_OK; chip++)
+    {
+        uint16_t addr = start_addr;
+        uint16_t left = length;
+        while (left > 0)
+        {
+            uint16_t space = EEPROM_PAGE_SIZE - addr % EEPROM_PAGE_SIZE;
+            uint16_t chunk = (left > space) ? space : left;
+
+            ret = EEPROM_WriteRaw(hi2c, EEPROM_CHIP_ADDR(chip), addr, blank, chunk);
+            if (ret != HAL_OK)
+                break;
+
+            addr += chunk;
+            left -= chunk;
+        }
+    }
+
+    // a partial wipe keeps the journal, the log stays readable instead of looking erased
+    if (ret == HAL_OK && start_addr == EEPROM_DATA_START_ADDR) {
+        ret = EEPROM_NewGeneration(hi2c, handle, 0);
+    }
+
+    handle->state = EEPROM_IDLE;
+    return ret;
+}
+
+/*
+ * @brief Empties the log. The logical erase only journals a new generation, the new log starts on the block
+ *        after the head so the wear keeps rotating. The secure erase overwrites the data area first.
+ * @param[1] hi2c pointer to the I2C handle
+ * @param[2] EEPROM structure pointer
+ * @param[3] EEPROM_ERASE_LOGICAL or EEPROM_ERASE_SECURE
+ * @retval HAL_Status, HAL_BUSY while a page write or read is in flight
+ *
+ * */
+HAL_StatusTypeDef EEPROM_EraseAll(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle, EEPROM_EraseMode mode)
+{
+    if (handle->status != EEPROM_STATUS_PRESENT)
+        return HAL_ERROR;
+    if (EEPROM_IsBusy(handle))
+        return HAL_BUSY;
+
+    if (mode == EEPROM_ERASE_SECURE)
+        return EEPROM_Erase(hi2c, handle, EEPROM_DATA_START_ADDR, EEPROM_DATA_RING_SIZE);
+
+    handle->state = EEPROM_BUSY;
+    HAL_StatusTypeDef ret = EEPROM_NewGeneration(hi2c, handle, EEPROM_BlockNext(handle->head_block));
+    handle->state = EEPROM_IDLE;
+    return ret;
+}
+
+/*
+ * @brief Writes the bytes to the EEPROM at the given address, split at page boundaries
+ * @param[1] hi2c pointer to the I2C handle
+ * @param[2] I2C address of the chip
+ * @param[3] EEPROM address
+ * @param[4] data to be written
+ * @param[5] size of data to be written
+ * @retval HAL_Status
+ *
+ * */
+static HAL_StatusTypeDef EEPROM_WriteRaw(I2C_HandleTypeDef *hi2c, uint16_t dev, uint16_t addr, const uint8_t *data, uint16_t size)
+{
+    EEPROM_Segment seg = { data, size };
+    return EEPROM_WriteSegments(hi2c, dev, addr, &seg, 1);
+}
+
+/*
+ * @brief Writes the segments back to back from the given address, split at page boundaries, and waits for
+ *        every write cycle. Nothing is copied: a page out of one segment is a single HAL_I2C_Mem_Write,
+ *        a page taking bytes of several segments is sent as one transaction with a frame per piece.
+ * @param[1] hi2c pointer to the I2C handle
+ * @param[2] I2C address of the chip
+ * @param[3] EEPROM address
+ * @param[4] segments to be written
+ * @param[5] number of segments
+ * @retval HAL_Status
+ *
+ * */
+static HAL_StatusTypeDef EEPROM_WriteSegments(I2C_HandleTypeDef *hi2c, uint16_t dev, uint16_t addr, const EEPROM_Segment *seg, uint8_t count)
+{
+    uint32_t left = 0;
+    for (uint8_t i = 0; i < count; i++)
+        left += seg[i].len;
+
+    uint8_t idx = 0;
+    uint16_t pos = 0;   // bytes of seg[idx] already written
+    while (left > 0) {
+        if (pos == seg[idx].len) {
+            idx++;
+            pos = 0;
+            continue;
+        }
+
+        uint16_t space = EEPROM_PAGE_SIZE - addr % EEPROM_PAGE_SIZE;
+        uint16_t run = (left < space) ? left : space;
+        HAL_StatusTypeDef ret;
+
+        if (seg[idx].len - pos >= run) {
+            ret = HAL_I2C_Mem_Write(hi2c, dev, addr, I2C_MEMADD_SIZE_16BIT, (uint8_t *)&seg[idx].data[pos], run, EEPROM_ACK_TIMEOUT_MS);
+            pos += run;
+        }
+        else {
+            // the page continues in the next segments, the bus is held between the frames
+            uint8_t cmd[2] = {
+                (uint8_t)(addr >> 8),
+                (uint8_t)(addr & 0xFF)
+            };
+            ret = EEPROM_SendFrame(hi2c, dev, cmd, 2, I2C_FIRST_FRAME);
+            for (uint16_t sent = 0; ret == HAL_OK && sent < run; ) {
+                if (pos == seg[idx].len) {
+                    idx++;
+                    pos = 0;
+                    continue;
+                }
+                uint16_t piece = seg[idx].len - pos;
+                if (piece > run - sent)
+                    piece = run - sent;
+                ret = EEPROM_SendFrame(hi2c, dev, &seg[idx].data[pos], piece,
+                                       (sent + piece == run) ? I2C_LAST_FRAME : I2C_NEXT_FRAME);
+                pos += piece;
+                sent += piece;
+            }
+        }
+
+        if (ret != HAL_OK)
+            return HAL_ERROR;
+        if (EEPROM_WaitForWriteCompletion(hi2c, dev) != HAL_OK)
+            return HAL_TIMEOUT;
+
+        addr += run;
+        left -= run;
+    }
+    return HAL_OK;
+}
+
+/*
+ * @brief Sends one frame of a sequential transmit and waits until it is on the bus
+ * @param[1] hi2c pointer to the I2C handle
+ * @param[2] I2C address of the chip
+ * @param[3] bytes of the frame
+ * @param[4] number of bytes
+ * @param[5] I2C_FIRST_FRAME, I2C_NEXT_FRAME or I2C_LAST_FRAME
+ * @retval HAL_Status
+ *
+ * */
+static HAL_StatusTypeDef EEPROM_SendFrame(I2C_HandleTypeDef *hi2c, uint16_t dev, const uint8_t *data, uint16_t len, uint32_t option)
+{
+    if (HAL_I2C_Master_Seq_Transmit_IT(hi2c, dev, (uint8_t *)data, len, option) != HAL_OK)
+        return HAL_ERROR;
+
+    uint32_t start = HAL_GetTick();
+    while (HAL_I2C_GetState(hi2c) != HAL_I2C_STATE_READY) {
+        if ((HAL_GetTick() - start) >= EEPROM_ACK_TIMEOUT_MS)
+            return HAL_TIMEOUT;
+    }
+    return (HAL_I2C_GetError(hi2c) == HAL_I2C_ERROR_NONE) ? HAL_OK : HAL_ERROR;
+}
+
+/*
+ * @brief Derives write pointer and used size from the head block
+ * @param EEPROM structure pointer
+ * @retval void
+ *
+ * */
+static void EEPROM_UpdatePointers(EEPROM_Handle *handle)
+{
+    uint16_t head = handle->head_block;
+    handle->write_ptr = (uint32_t)head * EEPROM_PAGE_SIZE + EEPROM_BLOCK_HDR_SIZE + handle->head_fill;
+
+    if (handle->has_wrapped) {
+        handle->used_size = EEPROM_MAX_USABLE_SIZE - (EEPROM_BLOCK_PAYLOAD - handle->head_fill);
+    }
+    else {
+        uint16_t blocks = (head + EEPROM_BLOCK_COUNT - handle->anchor_block) % EEPROM_BLOCK_COUNT;
+        handle->used_size = (uint32_t)blocks * EEPROM_BLOCK_PAYLOAD + handle->head_fill;
+    }
+}
+
+/*
+ * @brief Moves the head to the next block once the current one is full and committed
+ * @param EEPROM structure pointer
+ * @retval void
+ *
+ * */
+static void EEPROM_AdvanceHead(EEPROM_Handle *handle)
+{
+    handle->head_block = EEPROM_BlockNext(handle->head_block);
+    handle->head_seq++;
+    handle->head_fill = 0;
+    handle->stage_buf = EEPROM_FreeStagePage(handle);
+    handle->stage_len = 0;
+    handle->stage_sent = 0;
+
+    if (handle->head_block == handle->anchor_block) {
+        // new lap, the anchor is re-journaled with its new sequence number after the first commit
+        handle->has_wrapped = true;
+        handle->lap_pending = true;
+    }
+    EEPROM_UpdatePointers(handle);
+}
+
+/*
+ * @brief Picks the staging page for a new head block. A committed image is sent from where it was staged,
+ *        so it stays reserved until its page write is done; with one page per chip one is always free.
+ * @param EEPROM structure pointer
+ * @retval staging page no job is writing from
+ *
+ * */
+static uint8_t *EEPROM_FreeStagePage(EEPROM_Handle *handle)
+{
+    for (uint8_t page = 0; page < EEPROM_STAGE_PAGES; page++) {
+        uint8_t *buf = handle->stage_pages[page];
+        bool used = false;
+        for (uint8_t chip = 0; chip < EEPROM_CHIP_COUNT; chip++) {
+            if (handle->job[chip].phase != EEPROM_JOB_IDLE && handle->job[chip].buf == buf)
+                used = true;
+        }
+        if (!used)
+            return buf;
+    }
+    return handle->stage_buf;   // not reached
+}
+
+/*
+ * @brief Whether the head block can be handed to the write engine now. Its chip has to be free; a block
+ *        that starts a new lap goes alone, so a power loss never leaves a gap next to the anchor.
+ * @param EEPROM structure pointer
+ * @retval true if EEPROM_CommitStage would start the page write
+ *
+ * */
+static bool EEPROM_CommitReady(EEPROM_Handle *handle)
+{
+    if (handle->stream_active || handle->job[EEPROM_BlockChip(handle->head_block)].phase != EEPROM_JOB_IDLE)
+        return false;
+
+    for (uint8_t chip = 0; chip < EEPROM_CHIP_COUNT; chip++) {
+        EEPROM_Job *job = &handle->job[chip];
+        if (job->phase != EEPROM_JOB_IDLE && (handle->lap_pending || job->lap))
+            return false;
+    }
+    return true;
+}
+
+/*
+ * @brief Hands the head block image (header and all its data) to the write engine as one page write.
+ *        No meta data is written except once per lap. Pages that failed before are written first.
+ * @param EEPROM structure pointer
+ * @retval HAL_OK if the write was started or nothing is staged, HAL_BUSY while the engine is busy
+ *
+ * */
+static HAL_StatusTypeDef EEPROM_CommitStage(EEPROM_Handle *handle)
+{
+    if (handle->stream_active)
+        return HAL_BUSY;
+
+    if (EEPROM_JobFailed(handle)) {
+        // the block headers must reach the EEPROM in sequence
+        for (uint8_t chip = 0; chip < EEPROM_CHIP_COUNT; chip++) {
+            if (handle->job[chip].phase == EEPROM_JOB_FAILED)
+                EEPROM_StartJob(handle, chip);
+        }
+        return HAL_BUSY;
+    }
+
+    if (handle->stage_len == handle->stage_sent)
+        return HAL_OK;
+    if (!EEPROM_CommitReady(handle))
+        return HAL_BUSY;
+
+    uint8_t chip = EEPROM_BlockChip(handle->head_block);
+    EEPROM_Job *job = &handle->job[chip];
+    EEPROM_PackHeader(handle->stage_buf, handle->head_seq, handle->stage_len);
+    job->type = EEPROM_JOB_BLOCK;
+    job->lap = handle->lap_pending;
+    job->block = handle->head_block;
+    job->seq = handle->head_seq;
+    job->fill = handle->stage_len;
+    job->addr = EEPROM_BlockAddr(handle->head_block);
+    job->len = EEPROM_BLOCK_HDR_SIZE + handle->stage_len;
+    job->buf = handle->stage_buf;   // bytes staged later go behind job->len
+
+    handle->lap_pending = false;
+    handle->stage_sent = handle->stage_len;
+    handle->stage_writes = 0;
+    EEPROM_StartJob(handle, chip);
+    return HAL_OK;
+}
+
+/*
+ * @brief checks the flush policy against the staging buffer
+ * @param EEPROM structure pointer
+ * @retval true if the staged bytes have to be committed now
+ *
+ * */
+static bool EEPROM_FlushDue(EEPROM_Handle *handle)
+{
+    if (handle->stage_len == handle->stage_sent)
+        return false;
+
+    switch (handle->flush_mode) {
+    case EEPROM_FLUSH_EVERY_N:
+        return (handle->stage_writes >= handle->flush_param);
+    case EEPROM_FLUSH_EVERY_T:
+        return ((HAL_GetTick() - handle->stage_tick) >= (uint32_t)handle->flush_param * 1000U);
+    case EEPROM_FLUSH_ON_DEMAND:
+    default:
+        return false;
+    }
+}
+
+/*
+ * @brief Stages the number of Bytes passed, a block is committed once it is full or the flush policy is due.
+ *        Does not wait for the EEPROM, the page write runs in the background (see EEPROM_GetWriteStatus).
+ * @param[1] hi2c pointer to the I2C handle, the bus given to EEPROM_Init that the page writes run on
+ * @param[2] EEPROM structure pointer
+ * @param[3] data to be written
+ * @param[4] size of data to be written, at most EEPROM_MAX_WRITE_SIZE
+ * @retval HAL_Status, HAL_BUSY if the data needs a new block while the chip of the head is busy (nothing is staged then)
+ *
+ * */
+HAL_StatusTypeDef EEPROM_WriteBytes(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle, uint8_t *data, uint16_t size)
+{
+    if (hi2c != handle->hi2c || handle->status != EEPROM_STATUS_PRESENT || handle->state == EEPROM_BUSY || size > EEPROM_MAX_WRITE_SIZE)
+        return HAL_ERROR;
+
+    // a full block has to be handed to the engine before the head can move on
+    uint8_t room = EEPROM_BLOCK_PAYLOAD - handle->stage_len;
+    bool needs_commit = (size > room) && (handle->stage_sent < EEPROM_BLOCK_PAYLOAD);
+    if (needs_commit && (EEPROM_JobFailed(handle) || !EEPROM_CommitReady(handle))) {
+        EEPROM_CommitStage(handle);   // retries a failed page
+        return HAL_BUSY;
+    }
+
+    handle->state = EEPROM_BUSY;
+
+    HAL_StatusTypeDef ret = HAL_OK;
+    while (size > 0) {
+        room = EEPROM_BLOCK_PAYLOAD - handle->stage_len;
+        if (room == 0) {
+            if (handle->stage_sent < EEPROM_BLOCK_PAYLOAD) {
+                ret = EEPROM_CommitStage(handle);
+                if (ret != HAL_OK)
+                    break;
+            }
+            EEPROM_AdvanceHead(handle);
+            continue;
+        }
+
+        uint16_t chunk_size = (size < room) ? size : room;
+        if (handle->stage_len == handle->stage_sent)
+            handle->stage_tick = HAL_GetTick();
+
+        memcpy(&handle->stage_buf[EEPROM_BLOCK_HDR_SIZE + handle->stage_len], data, chunk_size);
+        handle->stage_len += chunk_size;
+
+        data += chunk_size;
+        size -= chunk_size;
+    }
+
+    if (ret == HAL_OK) {
+        handle->stage_writes++;
+        if (handle->stage_len == EEPROM_BLOCK_PAYLOAD || EEPROM_FlushDue(handle))
+            EEPROM_CommitStage(handle);   // busy engine: picked up by the next write or EEPROM_FlushIfDue
+    }
+
+    handle->state = EEPROM_IDLE;
+    return ret;
+}
+
+/*
+ * @brief Sets when the staging buffer is committed
+ * @param[1] EEPROM structure pointer
+ * @param[2] flush mode
+ * @param[3] number of writes for EEPROM_FLUSH_EVERY_N, seconds for EEPROM_FLUSH_EVERY_T
+ * @retval void
+ *
+ * */
+void EEPROM_SetFlushPolicy(EEPROM_Handle *handle, EEPROM_FlushMode mode, uint16_t param)
+{
+    handle->flush_mode = mode;
+    handle->flush_param = param;
+}
+
+/*
+ * @brief Starts the commit of whatever is staged, e.g. before power down or reading back the log.
+ *        Use EEPROM_WaitWriteComplete to wait for the page write.
+ * @param[1] hi2c pointer to the I2C handle, the bus given to EEPROM_Init that the page write runs on
+ * @param[2] EEPROM structure pointer
+ * @retval HAL_Status, HAL_BUSY if the chip of the head block is still busy
+ *
+ * */
+HAL_StatusTypeDef EEPROM_Flush(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle)
+{
+    if (hi2c != handle->hi2c || handle->status != EEPROM_STATUS_PRESENT || handle->state == EEPROM_BUSY)
+        return HAL_ERROR;
+
+    handle->state = EEPROM_BUSY;
+    HAL_StatusTypeDef ret = EEPROM_CommitStage(handle);
+    handle->state = EEPROM_IDLE;
+    return ret;
+}
+
+/*
+ * @brief Time until the time based flush policy is due, so EEPROM_FlushIfDue can be scheduled exactly
+ * @param EEPROM structure pointer
+ * @retval seconds, 0 if due, UINT32_MAX if nothing is staged or the policy is not EEPROM_FLUSH_EVERY_T
+ *
+ * */
+uint32_t EEPROM_FlushDueIn(EEPROM_Handle *handle)
+{
+    if (handle->flush_mode != EEPROM_FLUSH_EVERY_T || handle->stage_len == handle->stage_sent)
+        return UINT32_MAX;
+
+    uint32_t age = HAL_GetTick() - handle->stage_tick;
+    uint32_t limit = (uint32_t)handle->flush_param * 1000U;
+    return (age >= limit) ? 0 : (limit - age + 999U) / 1000U;
+}
+
+/*
+ * @brief Commits the staging buffer if the flush policy is due, meant to be called periodically
+ * @param[1] hi2c pointer to the I2C handle
+ * @param[2] EEPROM structure pointer
+ * @retval HAL_Status
+ *
+ * */
+HAL_StatusTypeDef EEPROM_FlushIfDue(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle)
+{
+    if (!EEPROM_FlushDue(handle) && !EEPROM_JobFailed(handle))
+        return HAL_OK;
+    return EEPROM_Flush(hi2c, handle);
+}
+
+/*
+ * @brief Moves a read pointer left on a block end or header to the data of that block
+ *        and counts the committed bytes from there to the write pointer
+ * @param EEPROM structure pointer
+ * @retval bytes available to read
+ *
+ * */
+static uint32_t EEPROM_ReadAvailable(EEPROM_Handle *handle)
+{
+    if (handle->read_ptr == handle->write_ptr)
+        return 0;   // everything committed has been read
+
+    if (handle->read_ptr >= EEPROM_LOG_SPAN)
+        handle->read_ptr = 0;
+    if (handle->read_ptr % EEPROM_PAGE_SIZE < EEPROM_BLOCK_HDR_SIZE)
+        handle->read_ptr += EEPROM_BLOCK_HDR_SIZE - handle->read_ptr % EEPROM_PAGE_SIZE;
+
+    uint16_t block = handle->read_ptr / EEPROM_PAGE_SIZE;
+    uint16_t offset = handle->read_ptr % EEPROM_PAGE_SIZE - EEPROM_BLOCK_HDR_SIZE;
+    if (block == handle->head_block)
+        return (handle->head_fill > offset) ? handle->head_fill - offset : 0;
+
+    uint16_t between = (handle->head_block + EEPROM_BLOCK_COUNT - block - 1) % EEPROM_BLOCK_COUNT;
+    return EEPROM_BLOCK_PAYLOAD - offset + (uint32_t)between * EEPROM_BLOCK_PAYLOAD + handle->head_fill;
+}
+
+/*
+ * @brief Reads the number of Bytes passed, skipping block headers. Staged bytes are only visible once committed
+ * @param[1] hi2c pointer to the I2C handle
+ * @param[2] EEPROM structure pointer
+ * @param[3] data to be read
+ * @param[4] size of data to be read
+ * @retval HAL_Status
+ *
+ * */
+HAL_StatusTypeDef EEPROM_ReadBytes(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle, uint8_t *data, uint16_t size)
+{
+    if (handle->status != EEPROM_STATUS_PRESENT || handle->state == EEPROM_BUSY)
+        return HAL_ERROR;
+    if (!EEPROM_JobsIdle(handle) || handle->stream_active)
+        return HAL_BUSY;   // committed pointers already cover the pages in flight
+
+    handle->state = EEPROM_BUSY;
+
+    uint16_t remaining = size;
+    uint8_t *ptr = data;
+
+    if (size > EEPROM_ReadAvailable(handle)) {
+        handle->state = EEPROM_IDLE;
+        return HAL_ERROR;  // Trying to read more than available
+    }
+
+    while (remaining > 0) {
+        // past a block end, go on with the data of the next block
+        if (handle->read_ptr >= EEPROM_LOG_SPAN)
+            handle->read_ptr = 0;
+        uint8_t offset = handle->read_ptr % EEPROM_PAGE_SIZE;
+        if (offset < EEPROM_BLOCK_HDR_SIZE) {
+            handle->read_ptr += EEPROM_BLOCK_HDR_SIZE - offset;
+            offset = EEPROM_BLOCK_HDR_SIZE;
+        }
+
+        uint16_t block = handle->read_ptr / EEPROM_PAGE_SIZE;
+        uint16_t addr = EEPROM_BlockAddr(block) + offset;
+        uint16_t chunk = EEPROM_PAGE_SIZE - offset;
+        if (remaining < chunk) chunk = remaining;
+
+        uint8_t addr_bytes[2] = {
+            (uint8_t)(addr >> 8),
+            (uint8_t)(addr & 0xFF)
+        };
+
+        if (HAL_I2C_Master_Transmit(hi2c, EEPROM_BlockDev(block), addr_bytes, 2, HAL_MAX_DELAY) != HAL_OK) {
+            handle->state = EEPROM_IDLE;
+            return HAL_ERROR;
+        }
+
+        if (HAL_I2C_Master_Receive(hi2c, EEPROM_BlockDev(block), ptr, chunk, HAL_MAX_DELAY) != HAL_OK) {
+            handle->state = EEPROM_IDLE;
+            return HAL_ERROR;
+        }
+
+        handle->read_ptr += chunk;
+        ptr += chunk;
+        remaining -= chunk;
+    }
+
+    handle->state = EEPROM_IDLE;
+    return HAL_OK;
+}
+
+/*
+ * @brief Streams the number of Bytes passed from the read pointer to chunk_cb without blocking.
+ *        A single chip is read in one addressed transaction: the address is sent once, then DMA frames
+ *        alternate between two buffers while the bus is held, so a full dump runs at bus speed.
+ *        Block headers (and the journal when the ring wraps) are read through and dropped.
+ *        An array is read block by block, every block is addressed on its own chip.
+ * @param[1] hi2c pointer to the I2C handle, the bus given to EEPROM_Init that the stream runs on
+ * @param[2] EEPROM structure pointer
+ * @param[3] size of data to be read
+ * @param[4] called from the DMA interrupt for every run of data, keep it short
+ * @retval HAL_Status, the end of the stream is reported by EEPROM_StreamCpltCallback
+ *
+ * */
+HAL_StatusTypeDef EEPROM_ReadStream(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle, uint32_t size, EEPROM_StreamCallback chunk_cb)
+{
+    if (hi2c != handle->hi2c || handle->status != EEPROM_STATUS_PRESENT || handle->state == EEPROM_BUSY || size == 0)
+        return HAL_ERROR;
+    if (!EEPROM_JobsIdle(handle) || handle->stream_active)
+        return HAL_BUSY;
+    if (size > EEPROM_ReadAvailable(handle))
+        return HAL_ERROR;  // Trying to read more than available
+
+    handle->stream_cb = chunk_cb;
+    handle->stream_left = size;
+
+    // flag first, the address phase completes in EEPROM_TxCpltHandler
+    handle->stream_active = true;
+    if (EEPROM_StreamSegment(handle) != HAL_OK) {
+        handle->stream_active = false;
+        return HAL_ERROR;
+    }
+    return HAL_OK;
+}
+
+/*
+ * @brief Starts the addressed read of the stream from the read pointer. With one chip it runs up to the
+ *        last data byte of the stream, rolling over at the array end; with an array it ends with the block.
+ * @param EEPROM structure pointer
+ * @retval HAL_Status of the address phase
+ *
+ * */
+static HAL_StatusTypeDef EEPROM_StreamSegment(EEPROM_Handle *handle)
+{
+    EEPROM_ReadAvailable(handle);   // moves the read pointer onto data
+
+    uint16_t block = handle->read_ptr / EEPROM_PAGE_SIZE;
+    uint16_t addr = EEPROM_BlockAddr(block) + handle->read_ptr % EEPROM_PAGE_SIZE;
+    uint16_t start = addr;
+
+    // bytes on the bus from the read pointer up to the last data byte of this read
+    uint32_t left = handle->stream_left;
+    uint32_t raw = 0;
+    for (;;) {
+        uint16_t data_end = EEPROM_BlockAddr(block) + EEPROM_PAGE_SIZE;
+        uint16_t chunk = (left < (uint32_t)(data_end - addr)) ? (uint16_t)left : (uint16_t)(data_end - addr);
+        raw += chunk;
+        left -= chunk;
+        if (left == 0 || EEPROM_CHIP_COUNT > 1)
+            break;
+        block = EEPROM_BlockNext(block);
+        addr = EEPROM_BlockAddr(block) + EEPROM_BLOCK_HDR_SIZE;
+        raw += (addr + EEPROM_TOTAL_SIZE - data_end) % EEPROM_TOTAL_SIZE;  // sequential reads roll over at the array end
+    }
+
+    handle->stream_chip = EEPROM_BlockChip(handle->read_ptr / EEPROM_PAGE_SIZE);
+    handle->stream_addr = start;
+    handle->stream_raw_left = (raw < 2) ? 2 : raw;  // a DMA frame takes at least 2 bytes
+    handle->stream_idx = 0;
+    handle->stream_cmd[0] = (start >> 8) & 0xFF;
+    handle->stream_cmd[1] = start & 0xFF;
+    return HAL_I2C_Master_Seq_Transmit_IT(handle->hi2c, EEPROM_CHIP_ADDR(handle->stream_chip), handle->stream_cmd, 2, I2C_FIRST_FRAME);
+}
+
+/*
+ * @brief Starts a walk over the log from the oldest committed sample to the current end.
+ *        Samples are assumed to be written whole, so a partial one at the oldest end is skipped.
+ * @param[1] EEPROM structure pointer
+ * @param[2] iterator
+ * @param[3] bytes per sample, 1 to EEPROM_MAX_WRITE_SIZE
+ * @retval void
+ *
+ * */
+void EEPROM_IterBegin(EEPROM_Handle *handle, EEPROM_Iterator *it, uint8_t sample_size)
+{
+    if (sample_size == 0 || sample_size > EEPROM_MAX_WRITE_SIZE)
+        sample_size = 1;
+
+    if (handle->has_wrapped) {
+        it->block = EEPROM_BlockNext(handle->head_block);
+        it->seq = handle->head_seq + 1 - EEPROM_BLOCK_COUNT;
+    }
+    else {
+        it->block = handle->anchor_block;
+        it->seq = handle->anchor_seq;
+    }
+    it->sample_size = sample_size;
+    it->offset = handle->used_size % sample_size;   // never reaches past the oldest block
+    it->remaining = handle->used_size - it->offset;
+}
+
+/*
+ * @brief Plans one addressed read from the iterator position, it stops at the ring end (at every block end of an array)
+ * @param[1] iterator, moved past the planned data
+ * @param[2] data bytes wanted
+ * @param[3] buffer space, headers read along take space as well
+ * @param[4] bytes to read from the EEPROM
+ * @retval data bytes the read returns
+ *
+ * */
+static uint16_t EEPROM_IterSpan(EEPROM_Iterator *it, uint16_t want, uint16_t space, uint16_t *raw)
+{
+    uint16_t got = 0;
+    *raw = 0;
+    while (got < want) {
+        uint8_t hdr = (it->offset == 0) ? EEPROM_BLOCK_HDR_SIZE : 0;
+        if (*raw + hdr >= space)
+            break;
+        uint16_t take = EEPROM_BLOCK_PAYLOAD - it->offset;
+        if (take > want - got)
+            take = want - got;
+        if (take > space - *raw - hdr)
+            take = space - *raw - hdr;
+
+        *raw += hdr + take;
+        got += take;
+        it->offset += take;
+        if (it->offset == EEPROM_BLOCK_PAYLOAD) {
+            it->block = EEPROM_BlockNext(it->block);
+            it->seq++;
+            it->offset = 0;
+            if (it->block == 0 || EEPROM_CHIP_COUNT > 1)
+                break;   // the journal and the meta data page follow, or the next block is on another chip
+        }
+    }
+    return got;
+}
+
+/*
+ * @brief Reads a planned span into data, checks the headers and moves the data down over them
+ * @param[1] hi2c pointer to the I2C handle
+ * @param[2] iterator, moved past the data
+ * @param[3] buffer
+ * @param[4] data bytes of the span
+ * @param[5] bytes to read from the EEPROM
+ * @retval HAL_Status, HAL_ERROR if a block does not carry the expected sequence number
+ *
+ * */
+static HAL_StatusTypeDef EEPROM_IterRead(I2C_HandleTypeDef *hi2c, EEPROM_Iterator *it, uint8_t *data, uint16_t got, uint16_t raw)
+{
+    uint16_t addr = EEPROM_BlockAddr(it->block) + ((it->offset == 0) ? 0 : EEPROM_BLOCK_HDR_SIZE + it->offset);
+    if (HAL_I2C_Mem_Read(hi2c, EEPROM_BlockDev(it->block), addr, I2C_MEMADD_SIZE_16BIT, data, raw, HAL_MAX_DELAY) != HAL_OK)
+        return HAL_ERROR;
+
+    uint16_t in = 0;
+    uint16_t out = 0;
+    while (out < got) {
+        if (it->offset == 0) {
+            uint8_t *hdr = &data[in];
+            uint16_t seq = (hdr[0] << 8) | hdr[1];
+            if (EEPROM_Crc8(hdr, EEPROM_BLOCK_HDR_SIZE - 1) != hdr[3] || seq != it->seq)
+                return HAL_ERROR;
+            in += EEPROM_BLOCK_HDR_SIZE;
+        }
+
+        uint16_t take = EEPROM_BLOCK_PAYLOAD - it->offset;
+        if (take > got - out)
+            take = got - out;
+        memmove(&data[out], &data[in], take);
+        in += take;
+        out += take;
+        it->offset += take;
+        if (it->offset == EEPROM_BLOCK_PAYLOAD) {
+            it->block = EEPROM_BlockNext(it->block);
+            it->seq++;
+            it->offset = 0;
+        }
+    }
+    return HAL_OK;
+}
+
+/*
+ * @brief Returns the next whole samples of a walk. Consecutive blocks are fetched with one addressed
+ *        read into data (two where the ring wraps, one per block on an array) and the headers are
+ *        stripped in place, so RAM use is just the caller's buffer.
+ * @param[1] hi2c pointer to the I2C handle
+ * @param[2] EEPROM structure pointer
+ * @param[3] iterator from EEPROM_IterBegin
+ * @param[4] buffer for the samples, at least EEPROM_BLOCK_HDR_SIZE + sample size long
+ * @param[5] size of the buffer
+ * @param[6] bytes returned, 0 at the end of the walk
+ * @retval HAL_Status, HAL_ERROR if the writer overwrote the blocks ahead of the walk (start again),
+ *         HAL_BUSY while a page write or stream owns the bus
+ *
+ * */
+HAL_StatusTypeDef EEPROM_IterNext(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle, EEPROM_Iterator *it, uint8_t *data, uint16_t size, uint16_t *len)
+{
+    *len = 0;
+    if (handle->status != EEPROM_STATUS_PRESENT || handle->state == EEPROM_BUSY || size < EEPROM_BLOCK_HDR_SIZE + it->sample_size)
+        return HAL_ERROR;
+    if (it->remaining == 0)
+        return HAL_OK;
+    if (!EEPROM_JobsIdle(handle) || handle->stream_active)
+        return HAL_BUSY;
+
+    // plan the reads first, shrinking until they return whole samples
+    uint16_t want = (size < it->remaining) ? size : it->remaining;
+    for (;;) {
+        want -= want % it->sample_size;
+        EEPROM_Iterator plan = *it;
+        uint16_t got = 0;
+        uint16_t raw;
+        while (got < want) {
+            uint16_t n = EEPROM_IterSpan(&plan, want - got, size - got, &raw);
+            if (n == 0)
+                break;
+            got += n;
+        }
+        if (got % it->sample_size == 0)
+            break;
+        want = got;
+    }
+
+    handle->state = EEPROM_BUSY;
+    HAL_StatusTypeDef ret = HAL_OK;
+    while (ret == HAL_OK && *len < want) {
+        uint16_t raw;
+        EEPROM_Iterator span = *it;
+        uint16_t got = EEPROM_IterSpan(&span, want - *len, size - *len, &raw);
+        if (got == 0)
+            break;
+        ret = EEPROM_IterRead(hi2c, it, &data[*len], got, raw);
+        if (ret == HAL_OK)
+            *len += got;
+    }
+    handle->state = EEPROM_IDLE;
+
+    it->remaining -= *len;
+    return ret;
+}
+
+/*
+ * @brief Requests the next DMA frame of the stream into the buffer at stream_idx
+ * @param EEPROM structure pointer
+ * @retval void
+ *
+ * */
+static void EEPROM_StreamNextFrame(EEPROM_Handle *handle)
+{
+    uint16_t len = (handle->stream_raw_left > EEPROM_STREAM_CHUNK) ? EEPROM_STREAM_CHUNK : handle->stream_raw_left;
+    if (handle->stream_raw_left - len == 1)
+        len--;   // leave 2 bytes for the last frame
+
+    handle->stream_raw_left -= len;
+    handle->stream_len[handle->stream_idx] = len;
+
+    // NEXT_FRAME keeps the bus, the last frame NACKs its final byte and sends the stop
+    uint32_t options = (handle->stream_raw_left == 0) ? I2C_LAST_FRAME : I2C_NEXT_FRAME;
+    if (HAL_I2C_Master_Seq_Receive_DMA(handle->hi2c, EEPROM_CHIP_ADDR(handle->stream_chip), handle->stream_buf[handle->stream_idx], len, options) != HAL_OK)
+        EEPROM_StreamFinish(handle, HAL_ERROR);
+}
+
+/*
+ * @brief Hands the data of a received frame to the consumer, skipping headers and the journal
+ * @param[1] EEPROM structure pointer
+ * @param[2] received bytes
+ * @param[3] number of bytes
+ * @retval void
+ *
+ * */
+static void EEPROM_StreamDeliver(EEPROM_Handle *handle, const uint8_t *buf, uint16_t len)
+{
+    while (len > 0 && handle->stream_left > 0) {
+        uint16_t addr = handle->stream_addr;
+        uint16_t run;
+        uint16_t block = 0;
+        bool data = false;
+
+        if (addr >= EEPROM_DATA_END_ADDR) {
+            run = EEPROM_TOTAL_SIZE - addr;   // journal, the stream rolls over to address 0
+        }
+        else if (addr < EEPROM_DATA_START_ADDR) {
+            run = EEPROM_DATA_START_ADDR - addr;   // meta data page
+        }
+        else {
+            block = EEPROM_PhysBlock(handle->stream_chip, addr);
+            uint16_t data_start = EEPROM_BlockAddr(block) + EEPROM_BLOCK_HDR_SIZE;
+            if (addr < data_start) {
+                run = data_start - addr;
+            }
+            else {
+                run = data_start + EEPROM_BLOCK_PAYLOAD - addr;
+                data = true;
+            }
+        }
+
+        if (run > len)
+            run = len;
+        if (data) {
+            uint16_t n = (run < handle->stream_left) ? run : handle->stream_left;
+            handle->stream_cb(handle, buf, n);
+            handle->stream_left -= n;
+            handle->read_ptr = (uint32_t)block * EEPROM_PAGE_SIZE + (addr + n - EEPROM_BlockAddr(block));
+        }
+
+        buf += run;
+        len -= run;
+        handle->stream_addr = (addr + run) % EEPROM_TOTAL_SIZE;
+    }
+}
+
+/*
+ * @brief Releases the bus and reports the end of the stream
+ * @param[1] EEPROM structure pointer
+ * @param[2] HAL_OK or HAL_ERROR
+ * @retval void
+ *
+ * */
+static void EEPROM_StreamFinish(EEPROM_Handle *handle, HAL_StatusTypeDef status)
+{
+    handle->stream_active = false;
+    EEPROM_StreamCpltCallback(handle, status);
+}
+
+/*
+ * @brief To be called from HAL_I2C_MasterRxCpltCallback of the EEPROM bus. The next frame is
+ *        started before the finished one is handed over, so the bus keeps running meanwhile.
+ *        After the last frame of a chip read the next block of an array is addressed.
+ * @param EEPROM structure pointer
+ * @retval void
+ *
+ * */
+void EEPROM_RxCpltHandler(EEPROM_Handle *handle)
+{
+    if (!handle->stream_active)
+        return;
+
+    uint8_t done = handle->stream_idx;
+    bool last = (handle->stream_raw_left == 0);
+    if (!last) {
+        handle->stream_idx ^= 1;
+        EEPROM_StreamNextFrame(handle);
+    }
+
+    EEPROM_StreamDeliver(handle, handle->stream_buf[done], handle->stream_len[done]);
+    if (!last || !handle->stream_active)
+        return;
+
+    if (handle->stream_left == 0)
+        EEPROM_StreamFinish(handle, HAL_OK);
+    else if (EEPROM_StreamSegment(handle) != HAL_OK)
+        EEPROM_StreamFinish(handle, HAL_ERROR);
+}
+
+/*
+ * @brief Called when EEPROM_ReadStream is done, override in the application
+ * @param[1] EEPROM structure pointer
+ * @param[2] HAL_OK or HAL_ERROR
+ * @retval void
+ *
+ * */
+__weak void EEPROM_StreamCpltCallback(EEPROM_Handle *handle, HAL_StatusTypeDef status)
+{
+    (void)handle;
+    (void)status;
+}
+
+/*
+ * @brief Whether the write engine or a stream owns the bus
+ * @param EEPROM structure pointer
+ * @retval true while a transfer is in flight or scheduled
+ *
+ * */
+static bool EEPROM_BusOwned(EEPROM_Handle *handle)
+{
+    return EEPROM_JobActive(handle) || handle->stream_active;
+}
+
+/*
+ * @brief Whether the write engine owns the bus
+ * @param EEPROM structure pointer
+ * @retval true while a page write or ACK poll of any chip is in flight or scheduled
+ *
+ * */
+static bool EEPROM_JobActive(EEPROM_Handle *handle)
+{
+    for (uint8_t chip = 0; chip < EEPROM_CHIP_COUNT; chip++) {
+        EEPROM_JobPhase phase = handle->job[chip].phase;
+        if ((phase != EEPROM_JOB_IDLE) && (phase != EEPROM_JOB_FAILED))
+            return true;
+    }
+    return false;
+}
+
+/*
+ * @brief Whether no chip has a page write in flight or failed
+ * @param EEPROM structure pointer
+ * @retval true if every job is idle
+ *
+ * */
+static bool EEPROM_JobsIdle(EEPROM_Handle *handle)
+{
+    for (uint8_t chip = 0; chip < EEPROM_CHIP_COUNT; chip++) {
+        if (handle->job[chip].phase != EEPROM_JOB_IDLE)
+            return false;
+    }
+    return true;
+}
+
+/*
+ * @brief Whether a page write timed out and waits to be written again
+ * @param EEPROM structure pointer
+ * @retval true if any job failed
+ *
+ * */
+static bool EEPROM_JobFailed(EEPROM_Handle *handle)
+{
+    for (uint8_t chip = 0; chip < EEPROM_CHIP_COUNT; chip++) {
+        if (handle->job[chip].phase == EEPROM_JOB_FAILED)
+            return true;
+    }
+    return false;
+}
+
+/*
+ * @brief Takes the bus for a transfer of a job. The jobs of several chips are driven from the thread,
+ *        the I2C interrupt and the tick, so the owner is set with interrupts masked.
+ * @param[1] EEPROM structure pointer
+ * @param[2] chip of the job
+ * @retval true if the bus was free, the completion is then dispatched to that job
+ *
+ * */
+static bool EEPROM_ClaimBus(EEPROM_Handle *handle, uint8_t chip)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    bool free = (handle->job_bus == EEPROM_CHIP_COUNT) && !handle->stream_active;
+    if (free)
+        handle->job_bus = chip;
+    __set_PRIMASK(primask);
+    return free;
+}
+
+/*
+ * @brief Starts the job prepared for a chip, EEPROM_ACK_TIMEOUT_MS counts from here
+ * @param[1] EEPROM structure pointer
+ * @param[2] chip of the job
+ * @retval void
+ *
+ * */
+static void EEPROM_StartJob(EEPROM_Handle *handle, uint8_t chip)
+{
+    handle->write_status = HAL_BUSY;
+    handle->job[chip].tick = HAL_GetTick();
+    EEPROM_SendJob(handle, chip);
+}
+
+/*
+ * @brief Sends the page write of a job, a bus that is not ready is retried from the tick
+ * @param[1] EEPROM structure pointer
+ * @param[2] chip of the job
+ * @retval void
+ *
+ * */
+static void EEPROM_SendJob(EEPROM_Handle *handle, uint8_t chip)
+{
+    EEPROM_Job *job = &handle->job[chip];
+
+    // phase and owner first, the completion interrupt may fire before the HAL call returns
+    job->phase = EEPROM_JOB_WRITE;
+    if (!EEPROM_ClaimBus(handle, chip)) {
+        job->poll_tick = HAL_GetTick() + EEPROM_POLL_INTERVAL_MS;
+        job->phase = EEPROM_JOB_RESEND;
+        return;
+    }
+    if (HAL_I2C_Mem_Write_IT(handle->hi2c, EEPROM_CHIP_ADDR(chip), job->addr, I2C_MEMADD_SIZE_16BIT,
+                             job->buf, job->len) != HAL_OK) {
+        handle->job_bus = EEPROM_CHIP_COUNT;
+        job->poll_tick = HAL_GetTick() + EEPROM_POLL_INTERVAL_MS;
+        job->phase = EEPROM_JOB_RESEND;
+    }
+}
+
+/*
+ * @brief Books a finished page write. A block that starts a new lap is followed by its journal record.
+ * @param[1] EEPROM structure pointer
+ * @param[2] chip of the job
+ * @retval void
+ *
+ * */
+static void EEPROM_FinishJob(EEPROM_Handle *handle, uint8_t chip)
+{
+    EEPROM_Job *job = &handle->job[chip];
+
+    if (job->type == EEPROM_JOB_BLOCK) {
+        // the head may already have moved on if the block was full
+        if (job->block == handle->head_block && job->seq == handle->head_seq) {
+            handle->head_fill = job->fill;
+            EEPROM_UpdatePointers(handle);
+        }
+
+        if (job->lap) {
+            handle->anchor_seq = job->seq;
+            EEPROM_RaiseFloor(handle);
+            job->phase = EEPROM_JOB_IDLE;
+
+            // a lap block goes alone, so the journal chip is free
+            EEPROM_Job *rec = &handle->job[0];
+            rec->buf = handle->journal_buf;
+            EEPROM_PackRecord(handle, rec->buf);
+            rec->type = EEPROM_JOB_JOURNAL;
+            rec->lap = false;
+            rec->addr = EEPROM_JOURNAL_ADDR + ((handle->meta_slot + 1) % EEPROM_JOURNAL_SLOTS) * EEPROM_JOURNAL_RECORD_SIZE;
+            rec->len = EEPROM_JOURNAL_RECORD_SIZE;
+            EEPROM_StartJob(handle, 0);
+            return;
+        }
+    }
+    else {
+        handle->meta_slot = (handle->meta_slot + 1) % EEPROM_JOURNAL_SLOTS;
+        handle->meta_seq++;
+    }
+
+    job->phase = EEPROM_JOB_IDLE;
+    if (EEPROM_JobActive(handle))
+        handle->write_status = HAL_BUSY;
+    else
+        handle->write_status = EEPROM_JobFailed(handle) ? HAL_TIMEOUT : HAL_OK;
+    EEPROM_WriteCpltCallback(handle, HAL_OK);
+}
+
+/*
+ * @brief To be called from HAL_I2C_MemTxCpltCallback and HAL_I2C_MasterTxCpltCallback of the EEPROM bus
+ * @param EEPROM structure pointer
+ * @retval void
+ *
+ * */
+void EEPROM_TxCpltHandler(EEPROM_Handle *handle)
+{
+    if (handle->stream_active) {
+        // stream address sent, the data follows after a repeated start
+        EEPROM_StreamNextFrame(handle);
+        return;
+    }
+
+    uint8_t chip = handle->job_bus;
+    if (chip >= EEPROM_CHIP_COUNT)
+        return;
+    handle->job_bus = EEPROM_CHIP_COUNT;
+
+    EEPROM_Job *job = &handle->job[chip];
+    switch (job->phase) {
+    case EEPROM_JOB_WRITE:
+        // the EEPROM ignores its address during the write cycle, poll once it should be done
+        job->poll_tick = HAL_GetTick() + EEPROM_WRITE_CYCLE_MS;
+        job->phase = EEPROM_JOB_WAIT;
+        break;
+    case EEPROM_JOB_PROBE:
+        // address acknowledged, the write cycle is over
+        EEPROM_FinishJob(handle, chip);
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * @brief To be called from HAL_I2C_ErrorCallback of the EEPROM bus. A NACK means the EEPROM is still
+ *        busy, the write or poll is repeated from the tick until EEPROM_ACK_TIMEOUT_MS runs out.
+ *        A stream is ended with HAL_ERROR.
+ * @param EEPROM structure pointer
+ * @retval void
+ *
+ * */
+void EEPROM_ErrorHandler(EEPROM_Handle *handle)
+{
+    if (handle->stream_active) {
+        EEPROM_StreamFinish(handle, HAL_ERROR);
+        return;
+    }
+
+    uint8_t chip = handle->job_bus;
+    if (chip >= EEPROM_CHIP_COUNT)
+        return;
+    handle->job_bus = EEPROM_CHIP_COUNT;
+
+    EEPROM_Job *job = &handle->job[chip];
+    switch (job->phase) {
+    case EEPROM_JOB_WRITE:
+        job->poll_tick = HAL_GetTick() + EEPROM_POLL_INTERVAL_MS;
+        job->phase = EEPROM_JOB_RESEND;
+        break;
+    case EEPROM_JOB_PROBE:
+        job->poll_tick = HAL_GetTick() + EEPROM_POLL_INTERVAL_MS;
+        job->phase = EEPROM_JOB_WAIT;
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * @brief Drives ACK polling and resends, to be called every millisecond (HAL_SYSTICK_Callback).
+ *        Costs a compare per chip when no page write is pending.
+ * @param EEPROM structure pointer
+ * @retval void
+ *
+ * */
+void EEPROM_TickHandler(EEPROM_Handle *handle)
+{
+    for (uint8_t chip = 0; chip < EEPROM_CHIP_COUNT; chip++) {
+        EEPROM_JobPhase phase = handle->job[chip].phase;
+        if (phase == EEPROM_JOB_WAIT || phase == EEPROM_JOB_RESEND)
+            EEPROM_PollJob(handle, chip, HAL_GetTick());
+    }
+}
+
+/*
+ * @brief Time until EEPROM_TickHandler has a poll or resend to send, the SysTick may be left out that long
+ * @param EEPROM structure pointer
+ * @retval ms until the next poll, 0 if due, UINT32_MAX if no page write waits
+ *
+ * */
+uint32_t EEPROM_IdleMs(EEPROM_Handle *handle)
+{
+    uint32_t idle = UINT32_MAX;
+    uint32_t now = HAL_GetTick();
+    for (uint8_t chip = 0; chip < EEPROM_CHIP_COUNT; chip++) {
+        EEPROM_Job *job = &handle->job[chip];
+        if (job->phase != EEPROM_JOB_WAIT && job->phase != EEPROM_JOB_RESEND)
+            continue;
+        int32_t left = (int32_t)(job->poll_tick - now);
+        uint32_t ms = (left > 0) ? (uint32_t)left : 0;
+        if (ms < idle)
+            idle = ms;
+    }
+    return idle;
+}
+
+/*
+ * @brief Sends the due ACK poll or resend of a job, or gives the job up after EEPROM_ACK_TIMEOUT_MS
+ * @param[1] EEPROM structure pointer
+ * @param[2] chip of the job
+ * @param[3] HAL tick
+ * @retval void
+ *
+ * */
+static void EEPROM_PollJob(EEPROM_Handle *handle, uint8_t chip, uint32_t now)
+{
+    EEPROM_Job *job = &handle->job[chip];
+    if ((int32_t)(now - job->poll_tick) < 0)
+        return;
+
+    if ((now - job->tick) > EEPROM_ACK_TIMEOUT_MS) {
+        // kept in the job, EEPROM_CommitStage starts it again before anything else
+        job->phase = EEPROM_JOB_FAILED;
+        handle->write_status = HAL_TIMEOUT;
+        EEPROM_WriteCpltCallback(handle, HAL_TIMEOUT);
+        return;
+    }
+
+    if (job->phase == EEPROM_JOB_RESEND) {
+        EEPROM_SendJob(handle, chip);
+        return;
+    }
+
+    // ACK poll: addressing the EEPROM with just the word address does not start a write cycle
+    job->probe[0] = (job->addr >> 8) & 0xFF;
+    job->probe[1] = job->addr & 0xFF;
+    job->phase = EEPROM_JOB_PROBE;
+    if (!EEPROM_ClaimBus(handle, chip)) {
+        job->poll_tick = now + EEPROM_POLL_INTERVAL_MS;
+        job->phase = EEPROM_JOB_WAIT;
+        return;
+    }
+    if (HAL_I2C_Master_Transmit_IT(handle->hi2c, EEPROM_CHIP_ADDR(chip), job->probe, 2) != HAL_OK) {
+        handle->job_bus = EEPROM_CHIP_COUNT;
+        job->poll_tick = now + EEPROM_POLL_INTERVAL_MS;
+        job->phase = EEPROM_JOB_WAIT;
+    }
+}
+
+/*
+ * @brief Result of the last page write
+ * @param EEPROM structure pointer
+ * @retval HAL_BUSY while any is in flight, HAL_OK or HAL_TIMEOUT once done
+ *
+ * */
+HAL_StatusTypeDef EEPROM_GetWriteStatus(EEPROM_Handle *handle)
+{
+    return handle->write_status;
+}
+
+/*
+ * @brief Sleeps until the page writes in flight are done, e.g. after EEPROM_Flush before power down.
+ *        Not to be called from an interrupt at or above the I2C and SysTick priority.
+ * @param[1] EEPROM structure pointer
+ * @param[2] timeout in ms
+ * @retval HAL_Status of the page write, HAL_TIMEOUT if it did not finish in time
+ *
+ * */
+HAL_StatusTypeDef EEPROM_WaitWriteComplete(EEPROM_Handle *handle, uint32_t timeout_ms)
+{
+    uint32_t start = HAL_GetTick();
+    while (EEPROM_JobActive(handle)) {
+        if ((HAL_GetTick() - start) > timeout_ms)
+            return HAL_TIMEOUT;
+        __WFI();   // woken by the I2C and SysTick interrupts
+    }
+    return handle->write_status;
+}
+
+/*
+ * @brief Called when a page write finished or timed out, override in the application
+ * @param[1] EEPROM structure pointer
+ * @param[2] HAL_OK or HAL_TIMEOUT
+ * @retval void
+ *
+ * */
+__weak void EEPROM_WriteCpltCallback(EEPROM_Handle *handle, HAL_StatusTypeDef status)
+{
+    (void)handle;
+    (void)status;
+}
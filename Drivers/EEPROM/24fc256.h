@@ -14,13 +14,56 @@
 
 // I2C config and EEPROM parameters
 #define EEPROM_I2C_ADDR              (0x50 << 1)   // 7-bit base address (0x50) shifted left
-#define EEPROM_TOTAL_SIZE            32768         // 32KB = 256Kb
+#ifndef EEPROM_CHIP_COUNT
+#define EEPROM_CHIP_COUNT            1             // 24FC256 on the bus, strapped A2..A0 = 0 .. EEPROM_CHIP_COUNT - 1
+#endif
+#define EEPROM_MAX_CHIPS             8             // A2..A0 select one of 8 addresses
+#define EEPROM_CHIP_ADDR(chip)       (EEPROM_I2C_ADDR + ((chip) << 1))
+#define EEPROM_TOTAL_SIZE            32768         // 32KB = 256Kb per chip
 #define EEPROM_PAGE_SIZE             64            // Max bytes per page write
-#define EEPROM_PTR_META_ADDR         0x0000        // Reserve first 5 bytes for reserved meta data
-#define EEPROM_DATA_START_ADDR       0x0005        // Start writing data after pointer storage
+#define EEPROM_PTR_META_ADDR         0x0000        // Meta data page, holds the legacy 5 byte block that is only read once to migrate to the journal
+#define EEPROM_DATA_START_ADDR       (EEPROM_PTR_META_ADDR + EEPROM_PAGE_SIZE) // Data starts on the page after the meta data page
+#define EEPROM_LEGACY_START_ADDR     0x0005        // Layout 1 and 2 data started right after the legacy block
 #define EEPROM_MAX_ADDR              (EEPROM_TOTAL_SIZE - 1)
-#define EEPROM_MAX_USABLE_SIZE       (EEPROM_TOTAL_SIZE - EEPROM_DATA_START_ADDR)
+
+// Meta data journal: sequence numbered records rotate over the last pages so no single page takes every update
+#define EEPROM_JOURNAL_PAGES         4
+#define EEPROM_JOURNAL_ADDR          (EEPROM_TOTAL_SIZE - EEPROM_JOURNAL_PAGES * EEPROM_PAGE_SIZE)
+#define EEPROM_JOURNAL_RECORD_SIZE   16            // Divides the page size so a record never straddles a page
+#define EEPROM_JOURNAL_SLOTS         ((EEPROM_JOURNAL_PAGES * EEPROM_PAGE_SIZE) / EEPROM_JOURNAL_RECORD_SIZE)
+#define EEPROM_JOURNAL_MAGIC         0x4A
+#define EEPROM_LAYOUT_VERSION        3             // 1: plain byte ring with pointers in the journal, 2: sequence stamped blocks,
+                                                   // 3: sequence stamped blocks on whole device pages
+
+#define EEPROM_DATA_END_ADDR         EEPROM_JOURNAL_ADDR // Data ring wraps here
+#define EEPROM_DATA_RING_SIZE        (EEPROM_DATA_END_ADDR - EEPROM_DATA_START_ADDR)
+#define EEPROM_LEGACY_RING_SIZE      (EEPROM_DATA_END_ADDR - EEPROM_LEGACY_START_ADDR)
+
+// Data blocks: every device page of the ring starts with a header {seq[2], fill, crc8}.
+// The head is found by binary searching the sequence numbers, no pointer has to be committed per write.
+// Block n is the page at EEPROM_DATA_START_ADDR + (n / EEPROM_CHIP_COUNT) * EEPROM_PAGE_SIZE of its chip,
+// so a block write or read is one device page.
+#define EEPROM_BLOCK_HDR_SIZE        4
+#define EEPROM_BLOCK_PAYLOAD         (EEPROM_PAGE_SIZE - EEPROM_BLOCK_HDR_SIZE)
+// With several chips the blocks are striped: block n is on chip n % EEPROM_CHIP_COUNT, so consecutive pages
+// go to different chips and one can be loaded while the others are in their write cycle. The journal stays on chip 0.
+#define EEPROM_CHIP_PAGES            (EEPROM_DATA_RING_SIZE / EEPROM_PAGE_SIZE) // Data ring pages of one chip
+#define EEPROM_BLOCK_COUNT           (EEPROM_CHIP_PAGES * EEPROM_CHIP_COUNT)
+#define EEPROM_MAX_USABLE_SIZE       ((uint32_t)EEPROM_BLOCK_COUNT * EEPROM_BLOCK_PAYLOAD)
+#define EEPROM_LOG_SPAN              ((uint32_t)EEPROM_BLOCK_COUNT * EEPROM_PAGE_SIZE) // Range of the logical read and write pointers
+#define EEPROM_LEGACY_GAP            (EEPROM_CHIP_PAGES * EEPROM_BLOCK_HDR_SIZE + 4 * EEPROM_PAGE_SIZE) // Head room for the in place layout 1 conversion
+#define EEPROM_LAYOUT2_BLOCK_COUNT   (EEPROM_DATA_END_ADDR / EEPROM_PAGE_SIZE) // Layout 2 block 0 was the partial page after the legacy block
 #define EEPROM_ACK_TIMEOUT_MS 		100				// Usually it takes about 5ms for each cycle
+#define EEPROM_WRITE_CYCLE_MS        5             // tWC, the first ACK poll is sent after it
+#define EEPROM_POLL_INTERVAL_MS      1             // ACK poll and resend interval of the write engine
+#define EEPROM_MAX_WRITE_SIZE        EEPROM_BLOCK_PAYLOAD // One block boundary per EEPROM_WriteBytes call
+#define EEPROM_STAGE_SIZE            EEPROM_PAGE_SIZE // RAM staging buffer holds at most one device page
+#define EEPROM_STAGE_PAGES           (EEPROM_CHIP_COUNT + 1) // One page per chip in flight and the head being staged
+#define EEPROM_STREAM_CHUNK          256           // Bytes per DMA frame of EEPROM_ReadStream, two frames are buffered
+
+#if (EEPROM_CHIP_COUNT < 1) || (EEPROM_CHIP_COUNT > EEPROM_MAX_CHIPS)
+#error "EEPROM_CHIP_COUNT must be 1 to 8"
+#endif
 
 // EEPROM presence/status
 typedef enum {
@@ -35,15 +78,113 @@ typedef enum {
     EEPROM_BUSY
 } EEPROM_State;
 
-// EEPROM handle struct
+// Commit policy for the RAM staging buffer (a full page is always committed)
+typedef enum {
+    EEPROM_FLUSH_ON_DEMAND = 0,   // Commit only on a full page or an explicit EEPROM_Flush
+    EEPROM_FLUSH_EVERY_N,         // Commit after every N calls to EEPROM_WriteBytes
+    EEPROM_FLUSH_EVERY_T          // Commit once the oldest staged byte is T seconds old
+} EEPROM_FlushMode;
+
+// Phase of the interrupt driven page write engine
+typedef enum {
+    EEPROM_JOB_IDLE = 0,
+    EEPROM_JOB_WRITE,             // Page write in flight
+    EEPROM_JOB_RESEND,            // Page write was not acknowledged, resent from the tick
+    EEPROM_JOB_WAIT,              // Write cycle running, next ACK poll from the tick
+    EEPROM_JOB_PROBE,             // ACK poll in flight
+    EEPROM_JOB_FAILED             // Timed out, the page is written again before anything else
+} EEPROM_JobPhase;
+
+// What the page in flight is
+typedef enum {
+    EEPROM_JOB_BLOCK = 0,         // Image of a data block
+    EEPROM_JOB_JOURNAL            // Meta data record
+} EEPROM_JobType;
+
+// How EEPROM_EraseAll clears the log
+typedef enum {
+    EEPROM_ERASE_LOGICAL = 0,     // Start a new generation with one journal write, old blocks are overwritten lazily
+    EEPROM_ERASE_SECURE           // Also overwrite the whole data area with 0xFF, one blocking write cycle per page
+} EEPROM_EraseMode;
+
+typedef struct EEPROM_Handle EEPROM_Handle;
+
+// One piece of a gathered write, the bytes are sent to the bus from where they are
+typedef struct {
+    const uint8_t *data;
+    uint16_t      len;
+} EEPROM_Segment;
+
+// Walks the log oldest to newest independent of read_ptr, the end is fixed when the walk starts
+typedef struct {
+    uint16_t      block;          // Block being read
+    uint16_t      seq;            // Sequence number that block must carry, a mismatch means it was overwritten
+    uint8_t       offset;         // Data bytes of that block already returned
+    uint8_t       sample_size;    // Bytes are only returned in whole samples
+    uint32_t      remaining;      // Data bytes left up to the end of the walk
+} EEPROM_Iterator;
+
+// Page write and ACK polling of one chip, the chips of an array run their write cycles side by side
 typedef struct {
+    volatile EEPROM_JobPhase phase; // Changed from the I2C and tick interrupts
+    EEPROM_JobType type;          // Block image or journal record
+    bool          lap;            // Block write starts a new lap, the anchor is journaled after it
+    uint16_t      block;          // Block written by the job
+    uint16_t      seq;            // Sequence number of that block
+    uint8_t       fill;           // Data bytes of that block
+    uint16_t      addr;           // EEPROM address of the page write
+    uint8_t       len;            // Bytes of the page write
+    uint8_t      *buf;            // Page in flight, the staged head image itself or the journal record
+    uint8_t       probe[2];       // Address bytes sent as ACK poll
+    uint32_t      tick;           // HAL tick when the job was started, for EEPROM_ACK_TIMEOUT_MS
+    uint32_t      poll_tick;      // HAL tick of the next ACK poll or resend
+} EEPROM_Job;
+
+// Receives the data of EEPROM_ReadStream chunk by chunk, called from the DMA interrupt
+typedef void (*EEPROM_StreamCallback)(EEPROM_Handle *handle, const uint8_t *data, uint16_t len);
+
+// EEPROM handle struct
+struct EEPROM_Handle {
+    I2C_HandleTypeDef *hi2c;      // Bus used by the interrupt driven write engine
     EEPROM_Status status;         // Whether EEPROM is detected
     EEPROM_State  state;          // Busy or idle
-    uint16_t      write_ptr;      // Current write pointer
-    uint16_t      read_ptr;       // Current read pointer
-    uint16_t      used_size;      // Total bytes written (up to max)
+    uint32_t      write_ptr;      // Log position after the last committed data byte, block * EEPROM_PAGE_SIZE + offset in the page
+    uint32_t      read_ptr;       // Current read position, same encoding
+    uint32_t      used_size;      // Total data bytes committed (up to max)
     bool          has_wrapped;    // True if write pointer wrapped around
-} EEPROM_Handle;
+    uint32_t      meta_seq;       // Sequence number of the newest journal record
+    uint8_t       meta_slot;      // Journal slot holding the newest record
+    uint16_t      generation;     // Bumped by every erase of the log, persisted in the journal
+    uint16_t      head_block;     // Block currently being filled
+    uint16_t      head_seq;       // Sequence number of the head block
+    uint8_t       head_fill;      // Data bytes of the head block already committed
+    uint16_t      anchor_block;   // Block the head search starts from, moved once per lap
+    uint16_t      anchor_seq;     // Sequence number of the anchor block
+    uint16_t      floor_seq;      // Blocks with an older sequence number are not part of the log
+    bool          lap_pending;    // Anchor has to be re-journaled after the next commit
+    uint8_t       stage_pages[EEPROM_STAGE_PAGES][EEPROM_STAGE_SIZE]; // Head images, a committed one stays put until its page write is done
+    uint8_t      *stage_buf;      // Image of the head block, header followed by data
+    uint8_t       stage_len;      // Data bytes in the image, committed or staged
+    uint8_t       stage_sent;     // Data bytes of the image handed to the write engine
+    uint16_t      stage_writes;   // EEPROM_WriteBytes calls since last commit
+    uint32_t      stage_tick;     // HAL tick when the first byte was staged
+    EEPROM_FlushMode flush_mode;  // When the staging buffer is committed
+    uint16_t      flush_param;    // N writes or T seconds, depending on flush_mode
+    EEPROM_Job    job[EEPROM_CHIP_COUNT]; // Write engine, one job per chip
+    uint8_t       journal_buf[EEPROM_JOURNAL_RECORD_SIZE]; // Journal record in flight
+    volatile uint8_t job_bus;     // Chip whose job transfer is on the bus, EEPROM_CHIP_COUNT when none
+    volatile HAL_StatusTypeDef write_status; // Result of the last job, HAL_BUSY while one is in flight
+    volatile bool stream_active;  // EEPROM_ReadStream owns the bus
+    EEPROM_StreamCallback stream_cb; // Consumer of the streamed data
+    uint8_t       stream_chip;    // Chip being read
+    uint16_t      stream_addr;    // EEPROM address of the next byte handed over
+    uint32_t      stream_raw_left;// Bytes of the chip read not requested yet, block headers and the journal included
+    uint32_t      stream_left;    // Data bytes still to be handed to stream_cb
+    uint8_t       stream_cmd[2];  // Start address, sent once per chip read
+    uint8_t       stream_buf[2][EEPROM_STREAM_CHUNK]; // DMA fills one while the other is handed over
+    uint16_t      stream_len[2];  // Bytes requested into each buffer
+    uint8_t       stream_idx;     // Buffer the DMA is filling
+};
 
 //Initialization and state check functions
 HAL_StatusTypeDef EEPROM_Init(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle);
@@ -52,13 +193,33 @@ bool EEPROM_IsBusy(EEPROM_Handle *handle);
 
 //Pointer Handling
 HAL_StatusTypeDef EEPROM_RestoreMetadata(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle);
-void EEPROM_StoreMetadata(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle);
+HAL_StatusTypeDef EEPROM_StoreMetadata(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle);
 
 //Read/Write Operations
 HAL_StatusTypeDef EEPROM_WriteBytes(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle, uint8_t *data, uint16_t size);
 HAL_StatusTypeDef EEPROM_ReadBytes(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle, uint8_t *data, uint16_t size);
+HAL_StatusTypeDef EEPROM_ReadStream(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle, uint32_t size, EEPROM_StreamCallback chunk_cb);
+void EEPROM_StreamCpltCallback(EEPROM_Handle *handle, HAL_StatusTypeDef status);
+void EEPROM_IterBegin(EEPROM_Handle *handle, EEPROM_Iterator *it, uint8_t sample_size);
+HAL_StatusTypeDef EEPROM_IterNext(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle, EEPROM_Iterator *it, uint8_t *data, uint16_t size, uint16_t *len);
+
+//Write staging
+void EEPROM_SetFlushPolicy(EEPROM_Handle *handle, EEPROM_FlushMode mode, uint16_t param);
+HAL_StatusTypeDef EEPROM_Flush(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle);
+HAL_StatusTypeDef EEPROM_FlushIfDue(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle);
+uint32_t EEPROM_FlushDueIn(EEPROM_Handle *handle);
+
+//Interrupt driven write engine, the handlers are called from the HAL I2C callbacks and the 1 ms tick
+void EEPROM_TxCpltHandler(EEPROM_Handle *handle);
+void EEPROM_RxCpltHandler(EEPROM_Handle *handle);
+void EEPROM_ErrorHandler(EEPROM_Handle *handle);
+void EEPROM_TickHandler(EEPROM_Handle *handle);
+uint32_t EEPROM_IdleMs(EEPROM_Handle *handle);
+HAL_StatusTypeDef EEPROM_GetWriteStatus(EEPROM_Handle *handle);
+HAL_StatusTypeDef EEPROM_WaitWriteComplete(EEPROM_Handle *handle, uint32_t timeout_ms);
+void EEPROM_WriteCpltCallback(EEPROM_Handle *handle, HAL_StatusTypeDef status);
 
 //Erase Functionality
-void EEPROM_Erase(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle, uint16_t start_addr, uint16_t length);
-void EEPROM_EraseAll(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle);
+HAL_StatusTypeDef EEPROM_Erase(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle, uint16_t start_addr, uint16_t length);
+HAL_StatusTypeDef EEPROM_EraseAll(I2C_HandleTypeDef *hi2c, EEPROM_Handle *handle, EEPROM_EraseMode mode);
 #endif /* EEPROM_24FC256_H_ */
@@ -0,0 +1,310 @@
+/*
+ * lm75.c
+ *
+ *  LM75 driver, the calls match the TMP100 driver so both fit behind temp_sensor.h
+ */
+#include "lm75.h"
+
+#if (TEMP_SENSOR == TEMP_SENSOR_LM75)
+
+/*Static function declaration
+ * */
+static LM75_STATUS LM75_WriteReg(I2C_HandleTypeDef *hi2c, LM75_Handle *handle, uint8_t reg, uint8_t *data, uint16_t len);
+static LM75_STATUS LM75_ReadReg(I2C_HandleTypeDef *hi2c, LM75_Handle *handle, uint8_t reg, uint8_t *data, uint16_t len);
+static LM75_STATUS LM75_Probe(I2C_HandleTypeDef *hi2c, uint16_t addr);
+
+/*
+ *@brief Initialises the LM75 at the default address and puts it into shutdown
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] LM75 structure pointer
+ *@retval LM75 Status
+ * */
+LM75_STATUS LM75_Init(I2C_HandleTypeDef *hi2c, LM75_Handle *handle)
+{
+    return LM75_InitAddr(hi2c, handle, LM75_I2C_ADDR);
+}
+
+/*
+ *@brief Same as LM75_Init for a sensor on another address, one handle per sensor
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] LM75 structure pointer
+ *@param[3] bus address, LM75_I2C_ADDR_N(n) for the A2:A0 strapping
+ *@retval LM75 Status
+ * */
+LM75_STATUS LM75_InitAddr(I2C_HandleTypeDef *hi2c, LM75_Handle *handle, uint16_t addr)
+{
+    handle->hi2c = hi2c;
+    handle->addr = addr;
+    handle->config = LM75_CONFIG_SHUTDOWN;
+    handle->conv_state = TMP_CONV_IDLE;
+    handle->conv_tick = 0;
+    handle->pointer = LM75_POINTER_UNKNOWN;
+    handle->bus_ops = 0;
+
+    if(LM75_Probe(hi2c, addr) != TMP_READY){
+    	return TMP_ERROR;
+    }
+
+    uint8_t config = handle->config;
+    return LM75_WriteReg(hi2c, handle, LM75_CONFIG_REG, &config, 1);
+}
+
+/*
+ *@brief Reads the last conversion result in 1/8 °C, the extra bits of a 9 bit part read as 0
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] LM75 structure pointer
+ *@param[3] raw used to return the read value
+ *@retval LM75 Status, TMP_ERROR also for a value outside -55..125 °C
+ * */
+LM75_STATUS LM75_ReadRaw(I2C_HandleTypeDef *hi2c, LM75_Handle *handle, int16_t *raw)
+{
+    uint8_t data[2];
+
+    if(LM75_ReadReg(hi2c, handle, LM75_TEMP_REG, data, 2) != TMP_READY){
+    	return TMP_ERROR;
+    }
+
+    int16_t value = (data[0] << 3) | (data[1] >> 5); //11 bit to 16 bit conversion
+
+	//checking for the signed bit before copying the 11bit number to 16bit
+    if (value & 0x400) value |= 0xF800;
+
+    if (value < LM75_RAW_MIN || value > LM75_RAW_MAX){
+    	return TMP_ERROR;
+    }
+    *raw = value;
+    return TMP_READY;
+}
+
+/*
+ *@brief Reads the last conversion result in 0.01 °C, see LM75_ReadRaw
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] LM75 structure pointer
+ *@param[3] centi used to return the read value
+ *@retval LM75 Status
+ * */
+LM75_STATUS LM75_ReadTemperature(I2C_HandleTypeDef *hi2c, LM75_Handle *handle, int16_t *centi)
+{
+    int16_t raw;
+
+    if(LM75_ReadRaw(hi2c, handle, &raw) != TMP_READY){
+    	return TMP_ERROR;
+    }
+    *centi = LM75_RAW_TO_CENTI(raw);
+    return TMP_READY;
+}
+
+/*
+ *@brief Leaves shutdown and converts continuously, or goes back into shutdown. While converting the
+ *       latest result is read with LM75_ReadRaw; one-shots are refused until shutdown.
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] LM75 structure pointer
+ *@param[3] true to convert continuously, false for shutdown
+ *@retval LM75 Status, TMP_BUSY while a one-shot is running
+ * */
+LM75_STATUS LM75_SetContinuous(I2C_HandleTypeDef *hi2c, LM75_Handle *handle, bool on)
+{
+    if(handle->conv_state == TMP_CONV_RUNNING){
+    	return TMP_BUSY;
+    }
+
+    uint8_t config = on ? (handle->config & ~LM75_CONFIG_SHUTDOWN) : (handle->config | LM75_CONFIG_SHUTDOWN);
+    if(LM75_WriteReg(hi2c, handle, LM75_CONFIG_REG, &config, 1) != TMP_READY){
+    	return TMP_ERROR;
+    }
+
+    handle->hi2c = hi2c;
+    handle->config = config;
+    return TMP_READY;
+}
+
+/*
+ *@brief Takes the sensor out of shutdown and returns at once. LM75_TickHandler marks the result ready
+ *       after the first conversion, LM75_FetchResult reads it and shuts the sensor down again.
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] LM75 structure pointer
+ *@retval LM75 Status, TMP_BUSY if a conversion is still running
+ * */
+LM75_STATUS LM75_StartOneShot(I2C_HandleTypeDef *hi2c, LM75_Handle *handle)
+{
+    if(handle->conv_state == TMP_CONV_RUNNING){
+    	return TMP_BUSY;
+    }
+    if(!(handle->config & LM75_CONFIG_SHUTDOWN)){
+    	return TMP_ERROR;	// converting continuously
+    }
+
+    uint8_t config = handle->config & ~LM75_CONFIG_SHUTDOWN;
+    if(LM75_WriteReg(hi2c, handle, LM75_CONFIG_REG, &config, 1) != TMP_READY){
+    	return TMP_ERROR;
+    }
+
+    handle->hi2c = hi2c;
+    handle->conv_tick = HAL_GetTick();
+    handle->conv_state = TMP_CONV_RUNNING;  // last, the tick handler may run right after
+    return TMP_READY;
+}
+
+/*
+ *@brief Whether the conversion started by LM75_StartOneShot is done
+ *@param LM75 structure pointer
+ *@retval true if LM75_FetchResult can read the result
+ * */
+bool LM75_IsResultReady(LM75_Handle *handle)
+{
+    return (handle->conv_state == TMP_CONV_DONE);
+}
+
+/*
+ *@brief Reads the result of the conversion and shuts the sensor down
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] LM75 structure pointer
+ *@param[3] centi used to return the read value in 0.01 °C
+ *@retval LM75 Status, TMP_BUSY while the conversion is running
+ * */
+LM75_STATUS LM75_FetchResult(I2C_HandleTypeDef *hi2c, LM75_Handle *handle, int16_t *centi)
+{
+    int16_t raw;
+
+    LM75_STATUS status = LM75_FetchRaw(hi2c, handle, &raw);
+    if(status != TMP_READY){
+    	return status;
+    }
+    *centi = LM75_RAW_TO_CENTI(raw);
+    return TMP_READY;
+}
+
+/*
+ *@brief Same as LM75_FetchResult in 1/8 °C
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] LM75 structure pointer
+ *@param[3] raw used to return the read value
+ *@retval LM75 Status, TMP_BUSY while the conversion is running
+ * */
+LM75_STATUS LM75_FetchRaw(I2C_HandleTypeDef *hi2c, LM75_Handle *handle, int16_t *raw)
+{
+    if(handle->conv_state == TMP_CONV_RUNNING){
+    	return TMP_BUSY;
+    }
+    if(handle->conv_state != TMP_CONV_DONE){
+    	return TMP_ERROR;	// no conversion started
+    }
+    handle->conv_state = TMP_CONV_IDLE;
+
+    LM75_STATUS status = LM75_ReadRaw(hi2c, handle, raw);
+    uint8_t config = handle->config;
+    if(LM75_WriteReg(hi2c, handle, LM75_CONFIG_REG, &config, 1) != TMP_READY){
+    	return TMP_ERROR;	// left converting
+    }
+    return status;
+}
+
+/*
+ *@brief To be called from HAL_SYSTICK_Callback, ends the conversion time of a running conversion
+ *@param LM75 structure pointer
+ *@retval void
+ * */
+void LM75_TickHandler(LM75_Handle *handle)
+{
+    if(handle->conv_state != TMP_CONV_RUNNING){
+    	return;
+    }
+    if((HAL_GetTick() - handle->conv_tick) >= LM75_CONV_TIME_MS){
+    	handle->conv_state = TMP_CONV_DONE;
+    	LM75_ConvCpltCallback(handle);
+    }
+}
+
+/*
+ *@brief Time the SysTick is not needed by this sensor, for a tickless idle
+ *@param LM75 structure pointer
+ *@retval ms until the running conversion is over, 0 if it is due, UINT32_MAX without one
+ * */
+uint32_t LM75_IdleMs(LM75_Handle *handle)
+{
+    if(handle->conv_state != TMP_CONV_RUNNING){
+    	return UINT32_MAX;
+    }
+    uint32_t elapsed = HAL_GetTick() - handle->conv_tick;
+    return (elapsed >= LM75_CONV_TIME_MS) ? 0 : LM75_CONV_TIME_MS - elapsed;
+}
+
+/*
+ *@brief Called from the SysTick interrupt once a result is ready, override in the application
+ *@param LM75 structure pointer
+ *@retval void
+ * */
+__weak void LM75_ConvCpltCallback(LM75_Handle *handle)
+{
+    (void)handle;
+}
+
+/*
+ *@brief Static function to write a register, the device pointer is left on it
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] LM75 structure pointer
+ *@param[3] register address
+ *@param[4] data to be written
+ *@param[5] number of bytes
+ *@retval LM75 Status
+ * */
+static LM75_STATUS LM75_WriteReg(I2C_HandleTypeDef *hi2c, LM75_Handle *handle, uint8_t reg, uint8_t *data, uint16_t len)
+{
+    handle->bus_ops++;
+    if(HAL_I2C_Mem_Write(hi2c, handle->addr, reg, 1, data, len, LM75_I2C_TIMEOUT_MS) != HAL_OK){
+    	handle->pointer = LM75_POINTER_UNKNOWN;
+    	return TMP_ERROR;
+    }
+    handle->pointer = reg;
+    return TMP_READY;
+}
+
+/*
+ *@brief Static function to read a register. If the device pointer is already on it the read is a plain receive,
+ *       otherwise the pointer is written in the same transaction with a repeated start
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] LM75 structure pointer
+ *@param[3] register address
+ *@param[4] data to be read
+ *@param[5] number of bytes
+ *@retval LM75 Status
+ * */
+static LM75_STATUS LM75_ReadReg(I2C_HandleTypeDef *hi2c, LM75_Handle *handle, uint8_t reg, uint8_t *data, uint16_t len)
+{
+    HAL_StatusTypeDef ret;
+
+    if(handle->pointer == reg){
+    	handle->bus_ops++;
+    	ret = HAL_I2C_Master_Receive(hi2c, handle->addr, data, len, LM75_I2C_TIMEOUT_MS);
+    }
+    else{
+    	handle->bus_ops += 2;
+    	ret = HAL_I2C_Mem_Read(hi2c, handle->addr, reg, 1, data, len, LM75_I2C_TIMEOUT_MS);
+    }
+
+    if(ret != HAL_OK){
+    	handle->pointer = LM75_POINTER_UNKNOWN;
+    	return TMP_ERROR;
+    }
+    handle->pointer = reg;
+    return TMP_READY;
+}
+
+/*
+ *@brief Static function to check for a sensor on the bus, with retries
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] bus address
+ *@retval LM75 Status
+ * */
+static LM75_STATUS LM75_Probe(I2C_HandleTypeDef *hi2c, uint16_t addr)
+{
+    for (uint8_t attempt = 0; attempt < LM75_I2C_RETRIES ; attempt++) {
+        if (HAL_I2C_IsDeviceReady(hi2c, addr, 3, LM75_I2C_TIMEOUT_MS) == HAL_OK) {
+            return TMP_READY;
+        }
+        HAL_Delay(LM75_RETRY_DELAY_MS);  // delay between retries
+    }
+    return TMP_ERROR;
+}
+
+#endif /* TEMP_SENSOR_LM75 */
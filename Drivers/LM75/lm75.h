@@ -0,0 +1,61 @@
+/*
+ * lm75.h
+ *
+ *  LM75A/LM75B class sensor (11 bit, 1/8 °C steps) with the same non-blocking one-shot API as the TMP100.
+ *  The part has no one-shot: it leaves shutdown for one conversion time and is shut down again on the fetch.
+ */
+
+#ifndef LM75_LM75_H_
+#define LM75_LM75_H_
+
+#include "stm32f1xx_hal.h"  // or your specific HAL
+#include <stdbool.h>
+#include "temp_sensor_conf.h"
+
+typedef TEMP_STATUS LM75_STATUS;
+
+typedef struct{
+	I2C_HandleTypeDef *hi2c;					// Bus of the sensor
+	uint16_t addr;								// Bus address, LM75_I2C_ADDR or LM75_I2C_ADDR_N()
+	uint8_t config;								// Config register as last written, in shutdown or continuous
+	uint8_t pointer;							// Register the device pointer is on, reading it needs no pointer write
+	uint32_t bus_ops;							// I2C address phases since LM75_Init, a read with pointer write counts 2
+	volatile TEMP_CONV_STATE conv_state;		// Changed from the SysTick interrupt
+	uint32_t conv_tick;							// HAL tick when the sensor left shutdown
+}LM75_Handle;
+
+#define LM75_I2C_ADDR  					(0x48 << 1)
+#define LM75_I2C_ADDR_N(n)				((0x48 + (n)) << 1)	// A2:A0 strapping n = 0..7, 0x48..0x4F
+#define LM75_TEMP_REG					0x00	// Temperature, 11 bit left aligned (9 bit on the original LM75)
+#define LM75_CONFIG_REG					0x01
+#define LM75_THYST_REG					0x02
+#define LM75_TOS_REG					0x03
+#define LM75_POINTER_UNKNOWN			0xFF	// Pointer register not known, the next read writes it
+#define LM75_CONFIG_SHUTDOWN			0x01	// Comparator mode, OS active low, 1 fault
+#define LM75_CONV_TIME_MS				100		// First conversion after shutdown, LM75A/LM75B; 300 for a National LM75
+#define LM75_RETRY_DELAY_MS				10		// Delay between retries
+#define LM75_I2C_TIMEOUT_MS				10		// Per transfer, a few bytes take well under 1 ms at 400 kHz
+#define LM75_I2C_RETRIES				5		// Number of retries
+#define LM75_RAW_MIN					(-55 * 8)	// Valid range in 1/8 °C steps, -55 °C
+#define LM75_RAW_MAX					(125 * 8)	// +125 °C
+#define LM75_RAW_PER_DEGREE				8
+#define LM75_RAW_TO_CENTI(raw)			((int16_t)(((int32_t)(raw) * 25) / 2))	// 1/8 °C to 0.01 °C
+
+LM75_STATUS LM75_Init(I2C_HandleTypeDef *hi2c, LM75_Handle *handle);
+LM75_STATUS LM75_InitAddr(I2C_HandleTypeDef *hi2c, LM75_Handle *handle, uint16_t addr);
+
+//Temperatures are integers, raw in 1/8 °C or centi in 0.01 °C
+LM75_STATUS LM75_ReadRaw(I2C_HandleTypeDef *hi2c, LM75_Handle *handle, int16_t *raw);
+LM75_STATUS LM75_ReadTemperature(I2C_HandleTypeDef *hi2c, LM75_Handle *handle, int16_t *centi);
+LM75_STATUS LM75_SetContinuous(I2C_HandleTypeDef *hi2c, LM75_Handle *handle, bool on);
+
+//Non-blocking conversion, the bus is free meanwhile
+LM75_STATUS LM75_StartOneShot(I2C_HandleTypeDef *hi2c, LM75_Handle *handle);
+bool LM75_IsResultReady(LM75_Handle *handle);
+LM75_STATUS LM75_FetchResult(I2C_HandleTypeDef *hi2c, LM75_Handle *handle, int16_t *centi);
+LM75_STATUS LM75_FetchRaw(I2C_HandleTypeDef *hi2c, LM75_Handle *handle, int16_t *raw);
+void LM75_TickHandler(LM75_Handle *handle);
+uint32_t LM75_IdleMs(LM75_Handle *handle);
+void LM75_ConvCpltCallback(LM75_Handle *handle);
+
+#endif /* LM75_LM75_H_ */
@@ -6,9 +6,21 @@
  */
 #include "tmp100.h"
 
+#if (TEMP_SENSOR == TEMP_SENSOR_TMP100) || (TEMP_SENSOR == TEMP_SENSOR_TMP102)
+
 /*Static function declaration
  * */
-static float TMP100_ConvertRawTemp(int16_t raw);
+static TMP100_STATUS TMP100_ConvertRawTemp(const uint8_t *data, int16_t *raw);
+static TMP100_STATUS TMP100_WriteLimit(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, uint8_t reg, int16_t centi);
+static TMP100_STATUS TMP100_WriteReg(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, uint8_t reg, uint8_t *data, uint16_t len);
+static TMP100_STATUS TMP100_ReadReg(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, uint8_t reg, uint8_t *data, uint16_t len);
+static uint16_t TMP100_ConvTime(TMP100_Handle *handle, uint8_t config);
+static uint16_t TMP100_ConvTimeMax(uint8_t res);
+static TMP100_STATUS TMP100_MeasureConv(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, uint8_t res, uint16_t limit, uint16_t *time);
+static TMP100_STATUS TMP100_CalibrateRes(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, uint8_t res);
+static TMP100_STATUS TMP100_Probe(I2C_HandleTypeDef *hi2c, uint16_t addr);
+static bool TMP100_ConvElapsed(TMP100_Handle *handle);
+static TMP100_STATUS TMP100_WriteConfig(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, uint8_t config);
 
 /*
  * @brief check if the device is present or not on the i2c bus
@@ -17,109 +29,672 @@ static float TMP100_ConvertRawTemp(int16_t raw);
  * */
 TMP100_STATUS TMP100_CheckStatus(I2C_HandleTypeDef *hi2c)
 {
-    TMP100_STATUS retStatus = TMP_ERROR;
+    return TMP100_Probe(hi2c, TMP100_I2C_ADDR);
+}
 
-    for (uint8_t attempt = 0; attempt < TMP100_I2C_RETRIES ; attempt++) {
-        if (HAL_I2C_IsDeviceReady(hi2c, TMP100_I2C_ADDR, 3, HAL_MAX_DELAY) == HAL_OK) {
-            retStatus = TMP_READY;
-            break;
-        }
-        HAL_Delay(TMP100_RETRY_DELAY_MS);  // delay between retries
+/*
+ *@brief Reads the last conversion result in 1/16 °C. In continuous conversion the pointer stays on the
+ *       temperature register, so every further read is a single receive
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP100 structure pointer
+ *@param[3] raw used to return the read value, sign extended 12 bit
+ *@retval TMP100 Status, TMP_ERROR also for a value outside -55..125 °C
+ * */
+TMP100_STATUS TMP100_ReadRaw(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, int16_t *raw)
+{
+    uint8_t data[2];
+
+    if(TMP100_ReadReg(hi2c, handle, TMP100_TEMP_REG, data, 2) != TMP_READY){
+    	return TMP_ERROR;
     }
+    return TMP100_ConvertRawTemp(data, raw);
+}
 
-    return retStatus;
+/*
+ *@brief Reads the last conversion result in 0.01 °C, see TMP100_ReadRaw
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP100 structure pointer
+ *@param[3] centi used to return the read value
+ *@retval TMP100 Status
+ * */
+TMP100_STATUS TMP100_ReadTemperature(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, int16_t *centi)
+{
+    int16_t raw;
+
+    if(TMP100_ReadRaw(hi2c, handle, &raw) != TMP_READY){
+    	return TMP_ERROR;
+    }
+    *centi = TMP100_RAW_TO_CENTI(raw);
+    return TMP_READY;
+}
+/*
+ *@brief Puts the sensor into shutdown with 12 bit resolution, every one-shot then takes a single config write
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP100 structure pointer
+ *@retval TMP100 Status
+ * */
+TMP100_STATUS TMP100_Init(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle)
+{
+    return TMP100_InitAddr(hi2c, handle, TMP100_I2C_ADDR);
 }
 
 /*
- *@brief By default we are using the continues conversion mode and 12 bit resolution which is okay for the 10 min logging
+ *@brief Same as TMP100_Init for a sensor on another address, one handle per sensor
  *@param[1] hi2c pointer to the handle to I2C
- *@param[2] float readVal used to return the read value
+ *@param[2] TMP100 structure pointer
+ *@param[3] bus address, TMP100_I2C_ADDR_N(n) for the ADD1/ADD0 strapping
  *@retval TMP100 Status
  * */
-TMP100_STATUS TMP100_ReadTemperature(I2C_HandleTypeDef *hi2c, float *readVal)
+TMP100_STATUS TMP100_InitAddr(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, uint16_t addr)
 {
-    uint8_t reg = TMP100_TEMP_REG;
-    uint8_t data[2];
+    handle->hi2c = hi2c;
+    handle->addr = addr;
+    handle->config = TMP100_CONFIG_SHUTDOWN_12BIT;
+    handle->conv_state = TMP_CONV_IDLE;
+    handle->conv_tick = 0;
+    handle->conv_time = 0;
+    for(uint8_t res = TMP_RES_9BIT; res <= TMP_RES_12BIT; res++){
+    	handle->conv_cal[res] = 0;
+    }
+    handle->cal_runs = 0;
+    handle->cal_done = 0;
+    handle->pointer = TMP100_POINTER_UNKNOWN;
+    handle->bus_ops = 0;
 
-    if(HAL_I2C_Master_Transmit(hi2c, TMP100_I2C_ADDR, &reg, 1, HAL_MAX_DELAY) != HAL_OK){
+    if(TMP100_Probe(hi2c, addr) != TMP_READY){
     	return TMP_ERROR;
     }
-    if(HAL_I2C_Master_Receive(hi2c, TMP100_I2C_ADDR, data, 2, HAL_MAX_DELAY) != HAL_OK){
-		return TMP_ERROR;
+
+    return TMP100_WriteConfig(hi2c, handle, handle->config);
+}
+
+/*
+ *@brief Incase we need to save some power as the logging has to be done in 10 mins interval we can go the one shot approach and sleep rest of the period.
+ *       Blocking version of TMP100_StartOneShot/TMP100_FetchResult: waits out the conversion time instead of polling the OS bit
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP100 structure pointer
+ *@param[3] centi used to return the read value in 0.01 °C
+ *@retval TMP100 Status
+ * */
+TMP100_STATUS TMP100_ReadTemperature_OneShot(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, int16_t *centi)
+{
+    TMP100_STATUS status = TMP100_StartOneShot(hi2c, handle);
+    if(status != TMP_READY){
+    	return status;
     }
-    //HAL_I2C_Mem_Read(hi2c, TMP100_I2C_ADDR, 0x00, I2C_MEMADD_SIZE_8BIT, data, 2, HAL_MAX_DELAY);
-    int16_t raw = (data[0] << 4) | (data[1] >> 4); //12 bit to 16 bit conversion
 
-    *readVal = TMP100_ConvertRawTemp(raw);
-	return (*readVal == TMP100_INVALID_TEMP) ? TMP_ERROR : TMP_READY;
+    HAL_Delay(handle->conv_time);
+    handle->conv_state = TMP_CONV_DONE;	// also without TMP100_TickHandler
+    return TMP100_FetchResult(hi2c, handle, centi);
+}
+
+/*
+ *@brief Selects the resolution, per sample or once per mission. In shutdown it costs no bus traffic,
+ *       the next one-shot trigger carries it; a continuously converting sensor is written at once.
+ *       After TMP100_Calibrate on a TMP102 a resolution not timed yet is timed here, blocking.
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP100 structure pointer
+ *@param[3] resolution, 9 bit converts 8 times faster than 12 bit
+ *@retval TMP100 Status, TMP_BUSY while a one-shot is running, TMP_TIMEOUT as for TMP100_Calibrate
+ * */
+TMP100_STATUS TMP100_SetResolution(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, TMP100_RESOLUTION res)
+{
+    if(handle->conv_state == TMP_CONV_RUNNING){
+    	return TMP_BUSY;
+    }
+#if (TEMP_SENSOR == TEMP_SENSOR_TMP102)
+    if(res != TMP_RES_12BIT){
+    	return TMP_ERROR;	// the TMP102 converts in 12 bit only
+    }
+#endif
+
+    uint8_t config = (handle->config & ~TMP100_CONFIG_RES_MASK) | (uint8_t)(res << TMP100_CONFIG_RES_SHIFT);
+    if(!(config & TMP100_CONFIG_SD)){
+    	if(TMP100_WriteConfig(hi2c, handle, config) != TMP_READY){
+    		return TMP_ERROR;
+    	}
+    }
+    handle->config = config;
+
+    if(handle->cal_runs != 0 && !(handle->cal_done & (1U << res)) && (config & TMP100_CONFIG_SD)){
+    	return TMP100_CalibrateRes(hi2c, handle, res);	// continuously converting: timed once back in shutdown
+    }
+    return TMP_READY;
+}
+
+/*
+ *@brief Leaves shutdown and converts back to back at the selected resolution, or goes back into shutdown.
+ *       While converting the latest result is read with TMP100_ReadRaw, a single receive from the second
+ *       read on; one-shots are refused until shutdown.
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP100 structure pointer
+ *@param[3] true to convert continuously, false for shutdown
+ *@retval TMP100 Status, TMP_BUSY while a one-shot is running
+ * */
+TMP100_STATUS TMP100_SetContinuous(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, bool on)
+{
+    if(handle->conv_state == TMP_CONV_RUNNING){
+    	return TMP_BUSY;
+    }
+
+    uint8_t config = on ? (handle->config & ~TMP100_CONFIG_SD) : (handle->config | TMP100_CONFIG_SD);
+    if(TMP100_WriteConfig(hi2c, handle, config) != TMP_READY){
+    	return TMP_ERROR;
+    }
+
+    handle->hi2c = hi2c;
+    handle->config = config;
+    return TMP_READY;
+}
+
+/*
+ *@brief Measures how long the installed part takes to finish a one-shot, blocking, and schedules its
+ *       one-shots at the slowest of the runs plus a margin instead of the datasheet maximum. Only the
+ *       TMP102 flags the end of a one-shot (OS reads 0 while converting, 1 when done); the OS/ALERT bit
+ *       of the TMP100/TMP101 reads the comparator, so they keep the datasheet times. Call it once at
+ *       boot while no one-shot is running, it takes runs times the real conversion time (about 26 ms).
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP100 structure pointer
+ *@param[3] conversions to time, 0 goes back to the datasheet times
+ *@retval TMP100 Status, TMP_TIMEOUT if the part is slower than specified (it is still scheduled at the
+ *        measured time, a conversion that never ends keeps the datasheet time)
+ * */
+TMP100_STATUS TMP100_Calibrate(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, uint8_t runs)
+{
+    if(handle->conv_state == TMP_CONV_RUNNING){
+    	return TMP_BUSY;
+    }
+    if(!(handle->config & TMP100_CONFIG_SD)){
+    	return TMP_ERROR;	// converting continuously for the thermostat
+    }
+
+    for(uint8_t res = TMP_RES_9BIT; res <= TMP_RES_12BIT; res++){
+    	handle->conv_cal[res] = 0;
+    }
+    handle->cal_done = 0;
+#if (TEMP_SENSOR == TEMP_SENSOR_TMP102)
+    handle->cal_runs = runs;
+    if(runs == 0){
+    	return TMP_READY;
+    }
+    return TMP100_CalibrateRes(hi2c, handle, TMP_RES_12BIT);	// R1:R0 read only
+#else
+    (void)hi2c;
+    (void)runs;
+    handle->cal_runs = 0;	// no conversion end to time, see above
+    return TMP_READY;
+#endif
+}
+
+/*
+ *@brief Triggers a one-shot conversion at the selected resolution and returns at once. TMP100_TickHandler
+ *       marks the result ready after the conversion time of that resolution, then it is read with
+ *       TMP100_FetchResult. Needs TMP100_Init first.
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP100 structure pointer
+ *@retval TMP100 Status, TMP_BUSY if a conversion is still running
+ * */
+TMP100_STATUS TMP100_StartOneShot(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle)
+{
+    if(handle->conv_state == TMP_CONV_RUNNING){
+    	return TMP_BUSY;
+    }
+    if(!(handle->config & TMP100_CONFIG_SD)){
+    	return TMP_ERROR;	// converting continuously for the thermostat
+    }
+
+    // the sensor is in shutdown, writing OS starts a single conversion
+    uint8_t config = handle->config | TMP100_OS_BIT_MASK;
+    if(TMP100_WriteConfig(hi2c, handle, config) != TMP_READY){
+    	return TMP_ERROR;
+    }
+
+    handle->hi2c = hi2c;
+    handle->conv_time = TMP100_ConvTime(handle, config);
+    handle->conv_tick = HAL_GetTick();
+    handle->conv_state = TMP_CONV_RUNNING;  // last, the tick handler may run right after
+    return TMP_READY;
+}
+
+/*
+ *@brief Whether the conversion started by TMP100_StartOneShot is done
+ *@param TMP100 structure pointer
+ *@retval true if TMP100_FetchResult can read the result
+ * */
+bool TMP100_IsResultReady(TMP100_Handle *handle)
+{
+    return (handle->conv_state == TMP_CONV_DONE);
+}
+
+/*
+ *@brief Reads the result of the one-shot conversion with a single register read
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP100 structure pointer
+ *@param[3] centi used to return the read value in 0.01 °C
+ *@retval TMP100 Status, TMP_BUSY while the conversion is running
+ * */
+TMP100_STATUS TMP100_FetchResult(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, int16_t *centi)
+{
+    int16_t raw;
+
+    TMP100_STATUS status = TMP100_FetchRaw(hi2c, handle, &raw);
+    if(status != TMP_READY){
+    	return status;
+    }
+    *centi = TMP100_RAW_TO_CENTI(raw);
+    return TMP_READY;
+}
+
+/*
+ *@brief Same as TMP100_FetchResult in 1/16 °C
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP100 structure pointer
+ *@param[3] raw used to return the read value
+ *@retval TMP100 Status, TMP_BUSY while the conversion is running
+ * */
+TMP100_STATUS TMP100_FetchRaw(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, int16_t *raw)
+{
+    if(handle->conv_state == TMP_CONV_RUNNING){
+    	return TMP_BUSY;
+    }
+    if(handle->conv_state != TMP_CONV_DONE){
+    	return TMP_ERROR;	// no conversion started
+    }
+
+    handle->conv_state = TMP_CONV_IDLE;
+    return TMP100_ReadRaw(hi2c, handle, raw);
+}
+
+/*
+ *@brief To be called from HAL_SYSTICK_Callback, ends the conversion time of a running one-shot
+ *@param TMP100 structure pointer
+ *@retval void
+ * */
+void TMP100_TickHandler(TMP100_Handle *handle)
+{
+    if(TMP100_ConvElapsed(handle)){
+    	TMP100_ConvCpltCallback(handle);
+    }
+}
+
+/*
+ *@brief Time the SysTick is not needed by this sensor, for a tickless idle
+ *@param TMP100 structure pointer
+ *@retval ms until the running conversion is over, 0 if it is due, UINT32_MAX without one
+ * */
+uint32_t TMP100_IdleMs(TMP100_Handle *handle)
+{
+    if(handle->conv_state != TMP_CONV_RUNNING){
+    	return UINT32_MAX;
+    }
+    uint32_t elapsed = HAL_GetTick() - handle->conv_tick;
+    return (elapsed >= handle->conv_time) ? 0 : handle->conv_time - elapsed;
+}
+
+/*
+ *@brief Called from the SysTick interrupt once a one-shot result is ready, override in the application
+ *@param TMP100 structure pointer
+ *@retval void
+ * */
+__weak void TMP100_ConvCpltCallback(TMP100_Handle *handle)
+{
+    (void)handle;
+}
+
+/*
+ *@brief Writes both thermostat limits, T_HIGH first so the band is never inverted on the way
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP100 structure pointer
+ *@param[3] lower limit in 0.01 °C
+ *@param[4] upper limit in 0.01 °C
+ *@retval TMP100 Status
+ * */
+TMP100_STATUS TMP100_SetLimits(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, int16_t t_low, int16_t t_high)
+{
+    if(t_low > t_high || t_low < TMP100_RAW_TO_CENTI(TMP100_RAW_MIN) || t_high > TMP100_RAW_TO_CENTI(TMP100_RAW_MAX)){
+    	return TMP_ERROR;
+    }
+    if(TMP100_WriteLimit(hi2c, handle, TMP100_THIGH_REG, t_high) != TMP_READY){
+    	return TMP_ERROR;
+    }
+    return TMP100_WriteLimit(hi2c, handle, TMP100_TLOW_REG, t_low);
 }
+
 /*
- *@brief Incase we need to save some power as the logging has to be done in 10 mins interval we can go the one shot approach and sleep rest of the period
+ *@brief Programs limits, polarity, fault queue and comparator/interrupt mode and switches to continuous
+ *       conversion, so ALERT follows the temperature without the MCU. One-shots are refused until TMP100_Init.
  *@param[1] hi2c pointer to the handle to I2C
- *@param[2] float readVal used to return the read value
+ *@param[2] TMP100 structure pointer
+ *@param[3] thermostat setup
  *@retval TMP100 Status
  * */
-TMP100_STATUS TMP100_ReadTemperature_OneShot(I2C_HandleTypeDef *hi2c, float *readVal)
+TMP100_STATUS TMP100_ConfigAlert(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, const TMP100_AlertConfig *alert)
 {
-    uint8_t config;
-    // Valid raw range: 0x800 (−55°C) to 0x7FF (+127°C)
+    if(TMP100_SetLimits(hi2c, handle, alert->t_low, alert->t_high) != TMP_READY){
+    	return TMP_ERROR;
+    }
 
-    // Seting shutdown + 12-bit resolution
-    config = TMP100_CONFIG_SHUTDOWN_12BIT;
-    if(HAL_I2C_Mem_Write(hi2c, TMP100_I2C_ADDR, TMP100_CONFIG_REG, 1, &config, 1, HAL_MAX_DELAY) != HAL_OK){
+    uint8_t config = (handle->config & TMP100_CONFIG_RES_MASK) | (uint8_t)(alert->faults << TMP100_CONFIG_FAULT_SHIFT);
+    if(alert->active_high){
+    	config |= TMP100_CONFIG_POL;
+    }
+    if(alert->mode == TMP_ALERT_INTERRUPT){
+    	config |= TMP100_CONFIG_TM;
+    }
+    if(TMP100_WriteConfig(hi2c, handle, config) != TMP_READY){
     	return TMP_ERROR;
     }
-    // Triggering one-shot conversion
-    config = TMP100_CONFIG_ONESHOT_12BIT;
-    if(HAL_I2C_Mem_Write(hi2c, TMP100_I2C_ADDR, TMP100_CONFIG_REG, 1, &config, 1, HAL_MAX_DELAY) != HAL_OK){
+
+    handle->hi2c = hi2c;
+    handle->config = config;
+    handle->conv_state = TMP_CONV_IDLE;
+    return TMP_READY;
+}
+
+/*
+ *@brief Interrupt mode watches one side at a time: above T_HIGH, then below T_LOW once cleared. With both
+ *       limits on one threshold ALERT fires on the next crossing of it whichever side the thermostat waits
+ *       for; one waiting for the side the temperature is already on fires at once and the read that clears
+ *       it turns it round. A band is watched by moving the threshold to the edge that can be crossed next.
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP100 structure pointer
+ *@param[3] threshold in 0.01 °C
+ *@retval TMP100 Status
+ * */
+TMP100_STATUS TMP100_ArmAlert(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, int16_t threshold)
+{
+    return TMP100_SetLimits(hi2c, handle, threshold, threshold);
+}
+
+/*
+ *@brief Reads the ALERT state from the OS/ALERT bit, in interrupt mode this read also clears it
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP100 structure pointer
+ *@param[3] true if ALERT is active
+ *@retval TMP100 Status
+ * */
+TMP100_STATUS TMP100_ReadAlert(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, bool *active)
+{
+    uint8_t config;
+    if(TMP100_ReadReg(hi2c, handle, TMP100_CONFIG_REG, &config, 1) != TMP_READY){
     	return TMP_ERROR;
     }
-    // Waiting for conversion (max 600ms for 12-bit)
-    //HAL_Delay(600);
 
-    //Poll OS bit until cleared or conversion complete is detected
-	uint32_t tickStart = HAL_GetTick();
-	do {
-		if(HAL_I2C_Mem_Read(hi2c, TMP100_I2C_ADDR, TMP100_CONFIG_REG, 1, &config, 1, HAL_MAX_DELAY) != HAL_OK){
-			return TMP_ERROR;
-		}
+    // the bit follows POL like the pin
+    bool level = (config & TMP100_OS_BIT_MASK) != 0;
+    *active = (handle->config & TMP100_CONFIG_POL) ? level : !level;
+    return TMP_READY;
+}
 
-		if ((HAL_GetTick() - tickStart) > TMP100_CONV_TIMEOUT_MS) {
-			return TMP_TIMEOUT;
-		}
-	} while (config & TMP100_OS_BIT_MASK);  // Wait until OS=0
+/*
+ *@brief Static function to write a limit register, 12 bit left aligned like the temperature register
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP100 structure pointer
+ *@param[3] TMP100_TLOW_REG or TMP100_THIGH_REG
+ *@param[4] limit in 0.01 °C
+ *@retval TMP100 Status
+ * */
+static TMP100_STATUS TMP100_WriteLimit(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, uint8_t reg, int16_t centi)
+{
+    int16_t raw = (int16_t)(((int32_t)centi * 4) / 25);	// 0.0625 °C steps
+    uint8_t data[2] = {
+    	(uint8_t)(raw >> 4),
+		(uint8_t)((raw & 0x0F) << 4)
+    };
 
-    // Read temperature
-    uint8_t temp_reg = TMP100_TEMP_REG;
-    uint8_t data[2];
-    if(HAL_I2C_Master_Transmit(hi2c, TMP100_I2C_ADDR, &temp_reg, 1, HAL_MAX_DELAY) != HAL_OK){
+    return TMP100_WriteReg(hi2c, handle, reg, data, 2);
+}
+
+/*
+ *@brief Static function to write the config register, on the TMP102 with its second byte
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP100 structure pointer
+ *@param[3] config register value
+ *@retval TMP100 Status
+ * */
+static TMP100_STATUS TMP100_WriteConfig(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, uint8_t config)
+{
+#if (TEMP_SENSOR == TEMP_SENSOR_TMP102)
+    uint8_t data[2] = { config, TMP102_CONFIG_BYTE2 };
+#else
+    uint8_t data[1] = { config };
+#endif
+    return TMP100_WriteReg(hi2c, handle, TMP100_CONFIG_REG, data, sizeof(data));
+}
+
+/*
+ *@brief Static function to write a register, the device pointer is left on it
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP100 structure pointer
+ *@param[3] register address
+ *@param[4] data to be written
+ *@param[5] number of bytes
+ *@retval TMP100 Status
+ * */
+static TMP100_STATUS TMP100_WriteReg(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, uint8_t reg, uint8_t *data, uint16_t len)
+{
+    handle->bus_ops++;
+    if(HAL_I2C_Mem_Write(hi2c, handle->addr, reg, 1, data, len, TMP100_I2C_TIMEOUT_MS) != HAL_OK){
+    	handle->pointer = TMP100_POINTER_UNKNOWN;
     	return TMP_ERROR;
-	}
-    if(HAL_I2C_Master_Receive(hi2c, TMP100_I2C_ADDR, data, 2, HAL_MAX_DELAY) != HAL_OK){
+    }
+    handle->pointer = reg;
+    return TMP_READY;
+}
+
+/*
+ *@brief Static function to read a register. If the device pointer is already on it the read is a plain receive,
+ *       otherwise the pointer is written in the same transaction with a repeated start
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP100 structure pointer
+ *@param[3] register address
+ *@param[4] data to be read
+ *@param[5] number of bytes
+ *@retval TMP100 Status
+ * */
+static TMP100_STATUS TMP100_ReadReg(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, uint8_t reg, uint8_t *data, uint16_t len)
+{
+    HAL_StatusTypeDef ret;
+
+    if(handle->pointer == reg){
+    	handle->bus_ops++;
+    	ret = HAL_I2C_Master_Receive(hi2c, handle->addr, data, len, TMP100_I2C_TIMEOUT_MS);
+    }
+    else{
+    	handle->bus_ops += 2;
+    	ret = HAL_I2C_Mem_Read(hi2c, handle->addr, reg, 1, data, len, TMP100_I2C_TIMEOUT_MS);
+    }
+
+    if(ret != HAL_OK){
+    	handle->pointer = TMP100_POINTER_UNKNOWN;
     	return TMP_ERROR;
     }
+    handle->pointer = reg;
+    return TMP_READY;
+}
 
-    int16_t raw = (data[0] << 4) | (data[1] >> 4);
+/*
+ *@brief Static function to time the one-shots of one resolution over handle->cal_runs conversions,
+ *       see TMP100_Calibrate. The resolution counts as timed afterwards, also after a timeout.
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP100 structure pointer
+ *@param[3] resolution
+ *@retval TMP100 Status
+ * */
+static TMP100_STATUS TMP100_CalibrateRes(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, uint8_t res)
+{
+    TMP100_STATUS status = TMP_READY;
+    uint16_t max_time = TMP100_ConvTimeMax(res);
+    uint16_t slowest = 0;
+
+    handle->conv_cal[res] = 0;
+    for(uint8_t run = 0; run < handle->cal_runs; run++){
+    	uint16_t time;
+    	TMP100_STATUS ret = TMP100_MeasureConv(hi2c, handle, res, 2 * max_time, &time);
+    	if(ret == TMP_ERROR){
+    		return TMP_ERROR;
+    	}
+    	if(ret == TMP_TIMEOUT){
+    		slowest = 0;	// never finished, stays on the datasheet time
+    		status = TMP_TIMEOUT;
+    		break;
+    	}
+    	if(time > slowest){
+    		slowest = time;
+    	}
+    }
+    handle->cal_done |= (uint8_t)(1U << res);
+    if(slowest == 0){
+    	return status;
+    }
 
-    *readVal = TMP100_ConvertRawTemp(raw);
-    if(*readVal == TMP100_INVALID_TEMP){
+    uint16_t cal = slowest + slowest / 8 + TMP100_CAL_MARGIN_MS;
+    if(slowest > max_time){
+    	status = TMP_TIMEOUT;	// degraded part, better late than a stale result
+    }
+    else if(cal > max_time){
+    	cal = max_time;
+    }
+    handle->conv_cal[res] = cal;
+    return status;
+}
+
+/*
+ *@brief Static function to time one one-shot conversion by polling the OS bit once per tick, TMP102 only:
+ *       it reads 0 while converting and 1 once the result is in. The pointer stays on the config register,
+ *       so every poll is a single receive.
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP100 structure pointer
+ *@param[3] resolution
+ *@param[4] time after which the conversion is given up in ms
+ *@param[5] time used to return the conversion time in ms
+ *@retval TMP100 Status, TMP_TIMEOUT if the OS bit did not clear in time
+ * */
+static TMP100_STATUS TMP100_MeasureConv(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, uint8_t res, uint16_t limit, uint16_t *time)
+{
+    uint8_t config = (handle->config & ~TMP100_CONFIG_RES_MASK) | (uint8_t)(res << TMP100_CONFIG_RES_SHIFT) | TMP100_OS_BIT_MASK;
+    if(TMP100_WriteConfig(hi2c, handle, config) != TMP_READY){
     	return TMP_ERROR;
     }
+
+    uint32_t start = HAL_GetTick();
+    uint32_t now = start;
+    do{
+    	while(HAL_GetTick() == now){}	// one poll per tick
+    	now = HAL_GetTick();
+    	if(TMP100_ReadReg(hi2c, handle, TMP100_CONFIG_REG, &config, 1) != TMP_READY){
+    		return TMP_ERROR;
+    	}
+    	if((now - start) > limit){
+    		return TMP_TIMEOUT;
+    	}
+    }while(!(config & TMP100_OS_BIT_MASK));	// set again once the conversion is over
+
+    *time = (uint16_t)(now - start);
     return TMP_READY;
 }
+
 /*
- *@brief Static function to calculate the temp value from raw values
- *@param int16 raw value to be converted into float val
- *@retval return the converted float value
+ *@brief Static function to check for a sensor on the bus, with retries
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] bus address
+ *@retval TMP100 Status
  * */
-static float TMP100_ConvertRawTemp(int16_t raw){
+static TMP100_STATUS TMP100_Probe(I2C_HandleTypeDef *hi2c, uint16_t addr)
+{
+    TMP100_STATUS retStatus = TMP_ERROR;
+
+    for (uint8_t attempt = 0; attempt < TMP100_I2C_RETRIES ; attempt++) {
+        if (HAL_I2C_IsDeviceReady(hi2c, addr, 3, TMP100_I2C_TIMEOUT_MS) == HAL_OK) {
+            retStatus = TMP_READY;
+            break;
+        }
+        HAL_Delay(TMP100_RETRY_DELAY_MS);  // delay between retries
+    }
+
+    return retStatus;
+}
+
+/*
+ *@brief Static function to end the conversion time of a running one-shot, from the SysTick interrupt
+ *@param TMP100 structure pointer
+ *@retval true if the conversion just got done
+ * */
+static bool TMP100_ConvElapsed(TMP100_Handle *handle)
+{
+    if(handle->conv_state != TMP_CONV_RUNNING){
+    	return false;
+    }
+    if((HAL_GetTick() - handle->conv_tick) < handle->conv_time){
+    	return false;
+    }
+    handle->conv_state = TMP_CONV_DONE;
+    return true;
+}
+
+/*
+ *@brief Static function to look up the conversion time of the resolution in a config value,
+ *       measured by TMP100_Calibrate or else the datasheet maximum
+ *@param[1] TMP100 structure pointer
+ *@param[2] config register value
+ *@retval conversion time in ms
+ * */
+static uint16_t TMP100_ConvTime(TMP100_Handle *handle, uint8_t config)
+{
+#if (TEMP_SENSOR == TEMP_SENSOR_TMP102)
+    (void)config;
+    uint8_t res = TMP_RES_12BIT;	// R1:R0 read only
+#else
+    uint8_t res = (config & TMP100_CONFIG_RES_MASK) >> TMP100_CONFIG_RES_SHIFT;
+#endif
+    if(handle->conv_cal[res] != 0){
+    	return handle->conv_cal[res];
+    }
+    return TMP100_ConvTimeMax(res);
+}
+
+/*
+ *@brief Static function to look up the datasheet maximum conversion time of a resolution
+ *@param resolution
+ *@retval conversion time in ms
+ * */
+static uint16_t TMP100_ConvTimeMax(uint8_t res)
+{
+#if (TEMP_SENSOR == TEMP_SENSOR_TMP102)
+    (void)res;
+    return TMP102_CONV_TIME_MS;	// always 12 bit
+#else
+    switch(res){
+    case TMP_RES_9BIT:
+    	return TMP100_CONV_TIME_9BIT_MS;
+    case TMP_RES_10BIT:
+    	return TMP100_CONV_TIME_10BIT_MS;
+    case TMP_RES_11BIT:
+    	return TMP100_CONV_TIME_11BIT_MS;
+    default:
+    	return TMP100_CONV_TIME_12BIT_MS;
+    }
+#endif
+}
+
+/*
+ *@brief Static function to extract the temp value from the register bytes, integer only
+ *@param[1] temperature register, 12 bit left aligned
+ *@param[2] raw used to return the value in 1/16 °C
+ *@retval TMP100 Status, TMP_ERROR outside the specified range
+ * */
+static TMP100_STATUS TMP100_ConvertRawTemp(const uint8_t *data, int16_t *raw){
+
+    int16_t value = (data[0] << 4) | (data[1] >> 4); //12 bit to 16 bit conversion
 
 	//checking for the signed bit before copying the 12bit number to 16bit
-    if (raw & 0x800) raw |= 0xF000;
+    if (value & 0x800) value |= 0xF000;
 
-    float temp = raw * 0.0625f;
-    if (temp < -55.0f || temp > 125.0f){
-		return TMP100_INVALID_TEMP;
+    if (value < TMP100_RAW_MIN || value > TMP100_RAW_MAX){
+		return TMP_ERROR;
     }
-	return temp;
+    *raw = value;
+	return TMP_READY;
 }
+
+#endif /* TEMP_SENSOR_TMP100 || TEMP_SENSOR_TMP102 */
@@ -9,27 +9,113 @@
 #define TMP100_TMP100_H_
 
 #include "stm32f1xx_hal.h"  // or your specific HAL
+#include <stdbool.h>
+#include "temp_sensor_conf.h"
 
+typedef TEMP_STATUS TMP100_STATUS;
+typedef TEMP_CONV_STATE TMP100_CONV_STATE;
+
+// Conversion resolution (R1:R0), every bit doubles the conversion time
+typedef enum{
+	TMP_RES_9BIT = 0,				// 0.5 °C
+	TMP_RES_10BIT,					// 0.25 °C
+	TMP_RES_11BIT,					// 0.125 °C
+	TMP_RES_12BIT					// 0.0625 °C
+}TMP100_RESOLUTION;
+
+// Consecutive out of limit conversions before ALERT changes (F1:F0)
+typedef enum{
+	TMP_FAULTS_1 = 0,
+	TMP_FAULTS_2,
+	TMP_FAULTS_4,
+	TMP_FAULTS_6
+}TMP100_FAULT_QUEUE;
+
+// ALERT function (TM bit)
 typedef enum{
-	TMP_READY = 0,
-	TMP_ERROR = 1,
-	TMP_TIMEOUT
-}TMP100_STATUS;
+	TMP_ALERT_COMPARATOR = 0,		// Active above T_HIGH until the temperature falls below T_LOW
+	TMP_ALERT_INTERRUPT				// Fires above T_HIGH, once cleared (any register read) below T_LOW, and so on
+}TMP100_ALERT_MODE;
+
+// Thermostat setup for TMP100_ConfigAlert
+typedef struct{
+	int16_t t_low;					// Lower limit in 0.01 °C
+	int16_t t_high;					// Upper limit in 0.01 °C
+	bool active_high;				// ALERT polarity (POL bit)
+	TMP100_FAULT_QUEUE faults;
+	TMP100_ALERT_MODE mode;
+}TMP100_AlertConfig;
+
+typedef struct{
+	I2C_HandleTypeDef *hi2c;						// Bus of the sensor
+	uint16_t addr;								// Bus address, TMP100_I2C_ADDR or TMP100_I2C_ADDR_N()
+	uint8_t config;								// Config register as last written, without OS
+	uint8_t pointer;							// Register the device pointer is on, reading it needs no pointer write
+	uint32_t bus_ops;							// I2C address phases since TMP100_Init, a read with pointer write counts 2
+	volatile TMP100_CONV_STATE conv_state;		// Changed from the SysTick interrupt
+	uint32_t conv_tick;							// HAL tick when the one-shot was triggered
+	uint16_t conv_time;							// Conversion time of the running one-shot in ms
+	uint16_t conv_cal[4];						// Measured conversion time per resolution with margin, 0 uses the datasheet
+	uint8_t cal_runs;							// Conversions timed per resolution, 0 keeps the datasheet times
+	uint8_t cal_done;							// Bit per resolution already timed, the others are timed when selected
+}TMP100_Handle;
 
 #define TMP100_I2C_ADDR  				(0x48 << 1)
-#define TMP100_CONFIG_SHUTDOWN_12BIT	0xA0	// 1010 0000 SD=1, OS=0, 12-bit
-#define TMP100_CONFIG_ONESHOT_12BIT		0xE0	// 1110 0000 SD=1, OS=1, 12-bit
+#define TMP100_I2C_ADDR_N(n)			((0x48 + (n)) << 1)	// ADD1/ADD0 strapping n = 0..7, 0x48..0x4F (TMP102 0..3)
+#define TMP100_CONFIG_SHUTDOWN_12BIT	0x61	// 0110 0001 SD=1, OS=0, 12-bit
+#define TMP100_CONFIG_ONESHOT_12BIT		0xE1	// 1110 0001 SD=1, OS=1, 12-bit
 #define TMP100_TEMP_REG					0x00	// Temperature register address in TMP100
 #define TMP100_CONFIG_REG				0x01	// Configuration register of TMP100
+#define TMP100_TLOW_REG					0x02	// Lower limit of the thermostat, same format as the temperature
+#define TMP100_THIGH_REG				0x03	// Upper limit of the thermostat
+#define TMP100_POINTER_UNKNOWN			0xFF	// Pointer register not known, the next read writes it
 #define TMP100_OS_BIT_MASK				0x80	// Bitmask to isolate bit 7 (OS) in config register
-#define TMP100_CONV_TIMEOUT_MS			1000 	// Timeout after 1000 ms
+#define TMP100_CONFIG_RES_SHIFT			5		// R1:R0, bits 6:5
+#define TMP100_CONFIG_RES_MASK			0x60
+#define TMP100_CONFIG_FAULT_SHIFT		3		// F1:F0, bits 4:3
+#define TMP100_CONFIG_POL				0x04	// ALERT active high
+#define TMP100_CONFIG_TM				0x02	// Interrupt mode
+#define TMP100_CONFIG_SD				0x01	// Shutdown, a conversion only on OS
+#define TMP100_CONV_TIME_9BIT_MS		75		// Max conversion times, the result is read once after it (typ 40 ms)
+#define TMP100_CONV_TIME_10BIT_MS		150		// typ 80 ms
+#define TMP100_CONV_TIME_11BIT_MS		300		// typ 160 ms
+#define TMP100_CONV_TIME_12BIT_MS		600		// typ 320 ms
+#define TMP102_CONV_TIME_MS				35		// Fixed 12 bit, typ 26 ms
+#define TMP100_CAL_MARGIN_MS			2		// Added to 1/8 over the slowest measured conversion, covers the 1 ms tick
+#define TMP102_CONFIG_BYTE2				0xA0	// Second config byte of the TMP102: CR 4 Hz, AL, EM off
 #define TMP100_RETRY_DELAY_MS			10		// Delay between retries
+#define TMP100_I2C_TIMEOUT_MS			10		// Per transfer, a few bytes take well under 1 ms at 400 kHz
 #define TMP100_I2C_RETRIES				5		// Number of retries
-#define TMP100_INVALID_TEMP				-1000.0f// Invalid temp return
+#define TMP100_RAW_MIN					(-55 * 16)	// Valid range in 1/16 °C steps, -55 °C
+#define TMP100_RAW_MAX					(125 * 16)	// +125 °C
+#define TMP100_RAW_PER_DEGREE			16
+#define TMP100_RAW_TO_CENTI(raw)		((int16_t)(((int32_t)(raw) * 25) / 4))	// 1/16 °C to 0.01 °C, truncated
 
 TMP100_STATUS TMP100_CheckStatus(I2C_HandleTypeDef *hi2c);
+TMP100_STATUS TMP100_Init(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle);
+TMP100_STATUS TMP100_InitAddr(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, uint16_t addr);
+
+//Temperatures are integers, raw in 1/16 °C or centi in 0.01 °C, no float on the way
+TMP100_STATUS TMP100_ReadRaw(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, int16_t *raw);
+TMP100_STATUS TMP100_ReadTemperature(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, int16_t *centi);
+TMP100_STATUS TMP100_ReadTemperature_OneShot(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, int16_t *centi);
+TMP100_STATUS TMP100_SetContinuous(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, bool on);
+
+//Non-blocking one-shot, the bus is free during the conversion
+TMP100_STATUS TMP100_SetResolution(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, TMP100_RESOLUTION res);
+TMP100_STATUS TMP100_Calibrate(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, uint8_t runs);
+TMP100_STATUS TMP100_StartOneShot(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle);
+bool TMP100_IsResultReady(TMP100_Handle *handle);
+TMP100_STATUS TMP100_FetchResult(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, int16_t *centi);
+TMP100_STATUS TMP100_FetchRaw(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, int16_t *raw);
+void TMP100_TickHandler(TMP100_Handle *handle);
+uint32_t TMP100_IdleMs(TMP100_Handle *handle);
+void TMP100_ConvCpltCallback(TMP100_Handle *handle);
 
-TMP100_STATUS TMP100_ReadTemperature(I2C_HandleTypeDef *hi2c, float *readVal);
-TMP100_STATUS TMP100_ReadTemperature_OneShot(I2C_HandleTypeDef *hi2c, float *readVal);
+//Thermostat, ALERT output on the TMP101/TMP102, the TMP100 reports it in the OS/ALERT bit only
+TMP100_STATUS TMP100_SetLimits(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, int16_t t_low, int16_t t_high);
+TMP100_STATUS TMP100_ConfigAlert(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, const TMP100_AlertConfig *alert);
+TMP100_STATUS TMP100_ArmAlert(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, int16_t threshold);
+TMP100_STATUS TMP100_ReadAlert(I2C_HandleTypeDef *hi2c, TMP100_Handle *handle, bool *active);
 
 #endif /* TMP100_TMP100_H_ */
@@ -0,0 +1,371 @@
+/*
+ * tmp117.c
+ *
+ *  TMP117 driver, the calls match the TMP100 driver so both fit behind temp_sensor.h
+ */
+#include "tmp117.h"
+
+#if (TEMP_SENSOR == TEMP_SENSOR_TMP117)
+
+/*Static function declaration
+ * */
+static TMP117_STATUS TMP117_WriteConfig(I2C_HandleTypeDef *hi2c, TMP117_Handle *handle, uint16_t config);
+static TMP117_STATUS TMP117_WriteReg(I2C_HandleTypeDef *hi2c, TMP117_Handle *handle, uint8_t reg, uint8_t *data, uint16_t len);
+static TMP117_STATUS TMP117_ReadReg(I2C_HandleTypeDef *hi2c, TMP117_Handle *handle, uint8_t reg, uint8_t *data, uint16_t len);
+static uint16_t TMP117_ConvTime(uint16_t config);
+static TMP117_STATUS TMP117_Probe(I2C_HandleTypeDef *hi2c, uint16_t addr);
+
+/*
+ *@brief Initialises the TMP117 at the default address: checks the device ID and puts it into shutdown,
+ *       it only converts on TMP117_StartOneShot
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP117 structure pointer
+ *@retval TMP117 Status
+ * */
+TMP117_STATUS TMP117_Init(I2C_HandleTypeDef *hi2c, TMP117_Handle *handle)
+{
+    return TMP117_InitAddr(hi2c, handle, TMP117_I2C_ADDR);
+}
+
+/*
+ *@brief Same as TMP117_Init for a sensor on another address, one handle per sensor
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP117 structure pointer
+ *@param[3] bus address, TMP117_I2C_ADDR_N(n) for the ADD0 strapping
+ *@retval TMP117 Status
+ * */
+TMP117_STATUS TMP117_InitAddr(I2C_HandleTypeDef *hi2c, TMP117_Handle *handle, uint16_t addr)
+{
+    handle->hi2c = hi2c;
+    handle->addr = addr;
+    handle->config = TMP117_CONFIG_SHUTDOWN_AVG8;
+    handle->conv_state = TMP_CONV_IDLE;
+    handle->conv_tick = 0;
+    handle->conv_time = 0;
+    handle->pointer = TMP117_POINTER_UNKNOWN;
+    handle->bus_ops = 0;
+
+    if(TMP117_Probe(hi2c, addr) != TMP_READY){
+    	return TMP_ERROR;
+    }
+
+    uint8_t id[2];
+    if(TMP117_ReadReg(hi2c, handle, TMP117_DEVICE_ID_REG, id, 2) != TMP_READY){
+    	return TMP_ERROR;
+    }
+    if(((id[0] << 8 | id[1]) & TMP117_DEVICE_ID_MASK) != TMP117_DEVICE_ID){
+    	return TMP_ERROR;	// another part on this address
+    }
+
+    // converts continuously after power on
+    return TMP117_WriteConfig(hi2c, handle, handle->config);
+}
+
+/*
+ *@brief Reads the last conversion result in 1/128 °C
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP117 structure pointer
+ *@param[3] raw used to return the read value
+ *@retval TMP117 Status, TMP_ERROR also for a value outside -55..150 °C
+ * */
+TMP117_STATUS TMP117_ReadRaw(I2C_HandleTypeDef *hi2c, TMP117_Handle *handle, int16_t *raw)
+{
+    uint8_t data[2];
+
+    if(TMP117_ReadReg(hi2c, handle, TMP117_TEMP_REG, data, 2) != TMP_READY){
+    	return TMP_ERROR;
+    }
+
+    int16_t value = (int16_t)((data[0] << 8) | data[1]);
+    if (value < TMP117_RAW_MIN || value > TMP117_RAW_MAX){
+    	return TMP_ERROR;
+    }
+    *raw = value;
+    return TMP_READY;
+}
+
+/*
+ *@brief Reads the last conversion result in 0.01 °C, see TMP117_ReadRaw
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP117 structure pointer
+ *@param[3] centi used to return the read value
+ *@retval TMP117 Status
+ * */
+TMP117_STATUS TMP117_ReadTemperature(I2C_HandleTypeDef *hi2c, TMP117_Handle *handle, int16_t *centi)
+{
+    int16_t raw;
+
+    if(TMP117_ReadRaw(hi2c, handle, &raw) != TMP_READY){
+    	return TMP_ERROR;
+    }
+    *centi = TMP117_RAW_TO_CENTI(raw);
+    return TMP_READY;
+}
+
+/*
+ *@brief Leaves shutdown and converts cycle after cycle with the selected averaging, or goes back into
+ *       shutdown. While converting the latest result is read with TMP117_ReadRaw; one-shots are refused
+ *       until shutdown.
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP117 structure pointer
+ *@param[3] true to convert continuously, false for shutdown
+ *@retval TMP117 Status, TMP_BUSY while a one-shot is running
+ * */
+TMP117_STATUS TMP117_SetContinuous(I2C_HandleTypeDef *hi2c, TMP117_Handle *handle, bool on)
+{
+    if(handle->conv_state == TMP_CONV_RUNNING){
+    	return TMP_BUSY;
+    }
+
+    uint16_t config = (handle->config & ~TMP117_CONFIG_MOD_MASK) | (on ? TMP117_CONFIG_MOD_CONTINUOUS : TMP117_CONFIG_MOD_SHUTDOWN);
+    if(TMP117_WriteConfig(hi2c, handle, config) != TMP_READY){
+    	return TMP_ERROR;
+    }
+
+    handle->hi2c = hi2c;
+    handle->config = config;
+    return TMP_READY;
+}
+
+/*
+ *@brief Selects the averaging. In shutdown it costs no bus traffic, the next trigger carries it;
+ *       a continuously converting sensor is written at once.
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP117 structure pointer
+ *@param[3] averaging, every step roughly quadruples the conversion time
+ *@retval TMP117 Status, TMP_BUSY while a one-shot is running
+ * */
+TMP117_STATUS TMP117_SetAveraging(I2C_HandleTypeDef *hi2c, TMP117_Handle *handle, TMP117_AVERAGING avg)
+{
+    if(handle->conv_state == TMP_CONV_RUNNING){
+    	return TMP_BUSY;
+    }
+
+    uint16_t config = (handle->config & ~TMP117_CONFIG_AVG_MASK) | (uint16_t)(avg << TMP117_CONFIG_AVG_SHIFT);
+    if((config & TMP117_CONFIG_MOD_MASK) == TMP117_CONFIG_MOD_CONTINUOUS){
+    	if(TMP117_WriteConfig(hi2c, handle, config) != TMP_READY){
+    		return TMP_ERROR;
+    	}
+    }
+    handle->config = config;
+    return TMP_READY;
+}
+
+/*
+ *@brief Triggers a one-shot conversion with the selected averaging and returns at once. TMP117_TickHandler
+ *       marks the result ready after the conversion time, the sensor is back in shutdown by then.
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP117 structure pointer
+ *@retval TMP117 Status, TMP_BUSY if a conversion is still running
+ * */
+TMP117_STATUS TMP117_StartOneShot(I2C_HandleTypeDef *hi2c, TMP117_Handle *handle)
+{
+    if(handle->conv_state == TMP_CONV_RUNNING){
+    	return TMP_BUSY;
+    }
+    if((handle->config & TMP117_CONFIG_MOD_MASK) == TMP117_CONFIG_MOD_CONTINUOUS){
+    	return TMP_ERROR;	// converting continuously
+    }
+
+    uint16_t config = (handle->config & ~TMP117_CONFIG_MOD_MASK) | TMP117_CONFIG_MOD_ONESHOT;
+    if(TMP117_WriteConfig(hi2c, handle, config) != TMP_READY){
+    	return TMP_ERROR;
+    }
+
+    handle->hi2c = hi2c;
+    handle->conv_time = TMP117_ConvTime(config);
+    handle->conv_tick = HAL_GetTick();
+    handle->conv_state = TMP_CONV_RUNNING;  // last, the tick handler may run right after
+    return TMP_READY;
+}
+
+/*
+ *@brief Whether the conversion started by TMP117_StartOneShot is done
+ *@param TMP117 structure pointer
+ *@retval true if TMP117_FetchResult can read the result
+ * */
+bool TMP117_IsResultReady(TMP117_Handle *handle)
+{
+    return (handle->conv_state == TMP_CONV_DONE);
+}
+
+/*
+ *@brief Reads the result of the one-shot conversion with a single register read
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP117 structure pointer
+ *@param[3] centi used to return the read value in 0.01 °C
+ *@retval TMP117 Status, TMP_BUSY while the conversion is running
+ * */
+TMP117_STATUS TMP117_FetchResult(I2C_HandleTypeDef *hi2c, TMP117_Handle *handle, int16_t *centi)
+{
+    int16_t raw;
+
+    TMP117_STATUS status = TMP117_FetchRaw(hi2c, handle, &raw);
+    if(status != TMP_READY){
+    	return status;
+    }
+    *centi = TMP117_RAW_TO_CENTI(raw);
+    return TMP_READY;
+}
+
+/*
+ *@brief Same as TMP117_FetchResult in 1/128 °C
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP117 structure pointer
+ *@param[3] raw used to return the read value
+ *@retval TMP117 Status, TMP_BUSY while the conversion is running
+ * */
+TMP117_STATUS TMP117_FetchRaw(I2C_HandleTypeDef *hi2c, TMP117_Handle *handle, int16_t *raw)
+{
+    if(handle->conv_state == TMP_CONV_RUNNING){
+    	return TMP_BUSY;
+    }
+    if(handle->conv_state != TMP_CONV_DONE){
+    	return TMP_ERROR;	// no conversion started
+    }
+
+    handle->conv_state = TMP_CONV_IDLE;
+    return TMP117_ReadRaw(hi2c, handle, raw);
+}
+
+/*
+ *@brief To be called from HAL_SYSTICK_Callback, ends the conversion time of a running one-shot
+ *@param TMP117 structure pointer
+ *@retval void
+ * */
+void TMP117_TickHandler(TMP117_Handle *handle)
+{
+    if(handle->conv_state != TMP_CONV_RUNNING){
+    	return;
+    }
+    if((HAL_GetTick() - handle->conv_tick) >= handle->conv_time){
+    	handle->conv_state = TMP_CONV_DONE;
+    	TMP117_ConvCpltCallback(handle);
+    }
+}
+
+/*
+ *@brief Time the SysTick is not needed by this sensor, for a tickless idle
+ *@param TMP117 structure pointer
+ *@retval ms until the running conversion is over, 0 if it is due, UINT32_MAX without one
+ * */
+uint32_t TMP117_IdleMs(TMP117_Handle *handle)
+{
+    if(handle->conv_state != TMP_CONV_RUNNING){
+    	return UINT32_MAX;
+    }
+    uint32_t elapsed = HAL_GetTick() - handle->conv_tick;
+    return (elapsed >= handle->conv_time) ? 0 : handle->conv_time - elapsed;
+}
+
+/*
+ *@brief Called from the SysTick interrupt once a one-shot result is ready, override in the application
+ *@param TMP117 structure pointer
+ *@retval void
+ * */
+__weak void TMP117_ConvCpltCallback(TMP117_Handle *handle)
+{
+    (void)handle;
+}
+
+/*
+ *@brief Static function to write the 16 bit config register, MSB first
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP117 structure pointer
+ *@param[3] config register value
+ *@retval TMP117 Status
+ * */
+static TMP117_STATUS TMP117_WriteConfig(I2C_HandleTypeDef *hi2c, TMP117_Handle *handle, uint16_t config)
+{
+    uint8_t data[2] = { (uint8_t)(config >> 8), (uint8_t)(config & 0xFF) };
+    return TMP117_WriteReg(hi2c, handle, TMP117_CONFIG_REG, data, 2);
+}
+
+/*
+ *@brief Static function to write a register, the device pointer is left on it
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP117 structure pointer
+ *@param[3] register address
+ *@param[4] data to be written
+ *@param[5] number of bytes
+ *@retval TMP117 Status
+ * */
+static TMP117_STATUS TMP117_WriteReg(I2C_HandleTypeDef *hi2c, TMP117_Handle *handle, uint8_t reg, uint8_t *data, uint16_t len)
+{
+    handle->bus_ops++;
+    if(HAL_I2C_Mem_Write(hi2c, handle->addr, reg, 1, data, len, TMP117_I2C_TIMEOUT_MS) != HAL_OK){
+    	handle->pointer = TMP117_POINTER_UNKNOWN;
+    	return TMP_ERROR;
+    }
+    handle->pointer = reg;
+    return TMP_READY;
+}
+
+/*
+ *@brief Static function to read a register. If the device pointer is already on it the read is a plain receive,
+ *       otherwise the pointer is written in the same transaction with a repeated start
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] TMP117 structure pointer
+ *@param[3] register address
+ *@param[4] data to be read
+ *@param[5] number of bytes
+ *@retval TMP117 Status
+ * */
+static TMP117_STATUS TMP117_ReadReg(I2C_HandleTypeDef *hi2c, TMP117_Handle *handle, uint8_t reg, uint8_t *data, uint16_t len)
+{
+    HAL_StatusTypeDef ret;
+
+    if(handle->pointer == reg){
+    	handle->bus_ops++;
+    	ret = HAL_I2C_Master_Receive(hi2c, handle->addr, data, len, TMP117_I2C_TIMEOUT_MS);
+    }
+    else{
+    	handle->bus_ops += 2;
+    	ret = HAL_I2C_Mem_Read(hi2c, handle->addr, reg, 1, data, len, TMP117_I2C_TIMEOUT_MS);
+    }
+
+    if(ret != HAL_OK){
+    	handle->pointer = TMP117_POINTER_UNKNOWN;
+    	return TMP_ERROR;
+    }
+    handle->pointer = reg;
+    return TMP_READY;
+}
+
+/*
+ *@brief Static function to look up the conversion time of the averaging in a config value
+ *@param config register value
+ *@retval conversion time in ms
+ * */
+static uint16_t TMP117_ConvTime(uint16_t config)
+{
+    switch((config & TMP117_CONFIG_AVG_MASK) >> TMP117_CONFIG_AVG_SHIFT){
+    case TMP117_AVG_1:
+    	return TMP117_CONV_TIME_AVG1_MS;
+    case TMP117_AVG_8:
+    	return TMP117_CONV_TIME_AVG8_MS;
+    case TMP117_AVG_32:
+    	return TMP117_CONV_TIME_AVG32_MS;
+    default:
+    	return TMP117_CONV_TIME_AVG64_MS;
+    }
+}
+
+/*
+ *@brief Static function to check for a sensor on the bus, with retries
+ *@param[1] hi2c pointer to the handle to I2C
+ *@param[2] bus address
+ *@retval TMP117 Status
+ * */
+static TMP117_STATUS TMP117_Probe(I2C_HandleTypeDef *hi2c, uint16_t addr)
+{
+    for (uint8_t attempt = 0; attempt < TMP117_I2C_RETRIES ; attempt++) {
+        if (HAL_I2C_IsDeviceReady(hi2c, addr, 3, TMP117_I2C_TIMEOUT_MS) == HAL_OK) {
+            return TMP_READY;
+        }
+        HAL_Delay(TMP117_RETRY_DELAY_MS);  // delay between retries
+    }
+    return TMP_ERROR;
+}
+
+#endif /* TEMP_SENSOR_TMP117 */
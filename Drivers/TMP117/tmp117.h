@@ -0,0 +1,82 @@
+/*
+ * tmp117.h
+ *
+ *  TMP117 high accuracy sensor (±0.1 °C, 1/128 °C steps) with the same non-blocking one-shot API as the TMP100
+ */
+
+#ifndef TMP117_TMP117_H_
+#define TMP117_TMP117_H_
+
+#include "stm32f1xx_hal.h"  // or your specific HAL
+#include <stdbool.h>
+#include "temp_sensor_conf.h"
+
+typedef TEMP_STATUS TMP117_STATUS;
+
+// Conversions averaged into one result (AVG1:AVG0), lower noise for a longer one-shot
+typedef enum{
+	TMP117_AVG_1 = 0,				// 15.5 ms
+	TMP117_AVG_8,					// 125 ms
+	TMP117_AVG_32,					// 500 ms
+	TMP117_AVG_64					// 1 s
+}TMP117_AVERAGING;
+
+typedef struct{
+	I2C_HandleTypeDef *hi2c;					// Bus of the sensor
+	uint16_t addr;								// Bus address, TMP117_I2C_ADDR or TMP117_I2C_ADDR_N()
+	uint16_t config;							// Config register as last written, in shutdown or continuous
+	uint8_t pointer;							// Register the device pointer is on, reading it needs no pointer write
+	uint32_t bus_ops;							// I2C address phases since TMP117_Init, a read with pointer write counts 2
+	volatile TEMP_CONV_STATE conv_state;		// Changed from the SysTick interrupt
+	uint32_t conv_tick;							// HAL tick when the one-shot was triggered
+	uint16_t conv_time;							// Conversion time of the running one-shot in ms
+}TMP117_Handle;
+
+#define TMP117_I2C_ADDR  				(0x48 << 1)
+#define TMP117_I2C_ADDR_N(n)			((0x48 + (n)) << 1)	// ADD0 to GND, V+, SDA, SCL: n = 0..3
+#define TMP117_TEMP_REG					0x00	// Temperature, 16 bit two's complement
+#define TMP117_CONFIG_REG				0x01	// Configuration, 16 bit
+#define TMP117_THIGH_REG				0x02
+#define TMP117_TLOW_REG					0x03
+#define TMP117_DEVICE_ID_REG			0x0F
+#define TMP117_DEVICE_ID				0x0117	// Bits 11:0 of the device ID register
+#define TMP117_DEVICE_ID_MASK			0x0FFF
+#define TMP117_POINTER_UNKNOWN			0xFF	// Pointer register not known, the next read writes it
+#define TMP117_CONFIG_MOD_CONTINUOUS	0x0000	// MOD1:MOD0 = 00, one conversion cycle after the other
+#define TMP117_CONFIG_MOD_SHUTDOWN		0x0400	// MOD1:MOD0 = 01, bits 11:10
+#define TMP117_CONFIG_MOD_ONESHOT		0x0C00	// MOD1:MOD0 = 11, back to shutdown after the conversion
+#define TMP117_CONFIG_MOD_MASK			0x0C00
+#define TMP117_CONFIG_AVG_SHIFT			5		// AVG1:AVG0, bits 6:5
+#define TMP117_CONFIG_AVG_MASK			0x0060
+#define TMP117_CONFIG_SHUTDOWN_AVG8		0x0420	// Power on averaging, in shutdown
+#define TMP117_CONV_TIME_AVG1_MS		18		// 15.5 ms per averaged conversion, 10 % margin for the oscillator
+#define TMP117_CONV_TIME_AVG8_MS		138
+#define TMP117_CONV_TIME_AVG32_MS		550
+#define TMP117_CONV_TIME_AVG64_MS		1100
+#define TMP117_RETRY_DELAY_MS			10		// Delay between retries
+#define TMP117_I2C_TIMEOUT_MS			10		// Per transfer, a few bytes take well under 1 ms at 400 kHz
+#define TMP117_I2C_RETRIES				5		// Number of retries
+#define TMP117_RAW_MIN					(-55 * 128)	// Valid range in 1/128 °C steps, -55 °C
+#define TMP117_RAW_MAX					(150 * 128)	// +150 °C, also rejects the -256 °C reset value
+#define TMP117_RAW_PER_DEGREE			128
+#define TMP117_RAW_TO_CENTI(raw)		((int16_t)(((int32_t)(raw) * 25) / 32))	// 1/128 °C to 0.01 °C, truncated
+
+TMP117_STATUS TMP117_Init(I2C_HandleTypeDef *hi2c, TMP117_Handle *handle);
+TMP117_STATUS TMP117_InitAddr(I2C_HandleTypeDef *hi2c, TMP117_Handle *handle, uint16_t addr);
+
+//Temperatures are integers, raw in 1/128 °C or centi in 0.01 °C
+TMP117_STATUS TMP117_ReadRaw(I2C_HandleTypeDef *hi2c, TMP117_Handle *handle, int16_t *raw);
+TMP117_STATUS TMP117_ReadTemperature(I2C_HandleTypeDef *hi2c, TMP117_Handle *handle, int16_t *centi);
+TMP117_STATUS TMP117_SetContinuous(I2C_HandleTypeDef *hi2c, TMP117_Handle *handle, bool on);
+
+//Non-blocking one-shot, the bus is free during the conversion
+TMP117_STATUS TMP117_SetAveraging(I2C_HandleTypeDef *hi2c, TMP117_Handle *handle, TMP117_AVERAGING avg);
+TMP117_STATUS TMP117_StartOneShot(I2C_HandleTypeDef *hi2c, TMP117_Handle *handle);
+bool TMP117_IsResultReady(TMP117_Handle *handle);
+TMP117_STATUS TMP117_FetchResult(I2C_HandleTypeDef *hi2c, TMP117_Handle *handle, int16_t *centi);
+TMP117_STATUS TMP117_FetchRaw(I2C_HandleTypeDef *hi2c, TMP117_Handle *handle, int16_t *raw);
+void TMP117_TickHandler(TMP117_Handle *handle);
+uint32_t TMP117_IdleMs(TMP117_Handle *handle);
+void TMP117_ConvCpltCallback(TMP117_Handle *handle);
+
+#endif /* TMP117_TMP117_H_ */
@@ -0,0 +1,360 @@
+/*
+ * temp_sensor.c
+ *
+ *  Sensor arrays on top of the driver selected in temp_sensor_conf.h
+ */
+#include "temp_sensor.h"
+
+/*Static function declaration
+ * */
+static TEMP_STATUS TEMP_ArrayTrigger(TEMP_Array *array);
+static TEMP_STATUS TEMP_ArrayDecimate(TEMP_Array *array, int16_t *centi);
+static int16_t TEMP_Filter(int16_t *raw, uint8_t count, TEMP_FILTER filter);
+static int16_t TEMP_RawMean(int32_t sum, uint16_t count);
+
+/*
+ *@brief Oversampling: every TEMP_ArrayStart takes count conversions per sensor, back to back, and
+ *       TEMP_ArrayFetch returns them reduced to one value. Costs count conversion times, not more bus
+ *       traffic per conversion; on a TMP100 9 bit x 8 takes as long as one 12 bit conversion.
+ *@param[1] array pointer
+ *@param[2] conversions per result, 1 to TEMP_BURST_MAX
+ *@param[3] reduction of the burst
+ *@retval TEMP Status, TMP_BUSY while a burst is running
+ * */
+TEMP_STATUS TEMP_ArraySetBurst(TEMP_Array *array, uint8_t count, TEMP_FILTER filter)
+{
+    if(count == 0 || count > TEMP_BURST_MAX){
+    	return TMP_ERROR;
+    }
+    if(array->conv_state == TMP_CONV_RUNNING || array->burst_idx != 0){
+    	return TMP_BUSY;
+    }
+
+    array->burst = count;
+    array->filter = filter;
+    return TMP_READY;
+}
+
+/*
+ *@brief High-rate monitoring: every sensor converts continuously, TEMP_ArrayTickHandler makes a read due
+ *       every period and TEMP_ArrayFetch reads the latest result of each sensor, a single receive. The reads
+ *       are decimated on the fly by a boxcar (a first order CIC): TMP_BUSY is returned until decim reads are
+ *       summed, then their mean per sensor. One result per decim x period ms leaves the array, whatever the
+ *       read rate. A read slot the application misses is skipped, so the mean stays over decim reads.
+ *       The sensors convert at their own rate, a period below one conversion time reads the same result again.
+ *@param[1] array pointer
+ *@param[2] ms between reads, 0 puts the sensors back into shutdown for TEMP_ArrayStart
+ *@param[3] reads per result, at least 1
+ *@retval TEMP Status, TMP_ERROR if no sensor converts, TMP_BUSY while one-shots are running
+ * */
+TEMP_STATUS TEMP_ArraySetContinuous(TEMP_Array *array, uint16_t period, uint16_t decim)
+{
+    if(period != 0 && decim == 0){
+    	return TMP_ERROR;
+    }
+    if(array->period == 0 && (array->conv_state == TMP_CONV_RUNNING || array->burst_idx != 0)){
+    	return TMP_BUSY;
+    }
+
+    array->period = 0;	// first, the tick handler leaves the array alone from here on
+    array->conv_state = TMP_CONV_IDLE;
+    uint16_t started = 0;
+    for(uint8_t i = 0; i < array->count; i++){
+    	TEMP_Channel *channel = &array->channels[i];
+    	channel->decim_sum = 0;
+    	channel->decim_count = 0;
+    	if(period == 0 && !(array->started & (1u << i))){
+    		continue;	// never left shutdown
+    	}
+    	if(TEMP_SetContinuous(channel->sensor.hi2c, &channel->sensor, period != 0) == TMP_READY){
+    		started |= (uint16_t)(1u << i);
+    	}
+    }
+    if(period == 0){
+    	array->started = 0;
+    	return TMP_READY;
+    }
+    if(started == 0){
+    	return TMP_ERROR;
+    }
+
+    array->started = started;
+    array->decim = decim;
+    array->decim_idx = 0;
+    array->period_tick = HAL_GetTick();
+    array->period = period;
+    array->conv_state = TMP_CONV_RUNNING;  // last, the tick handler may run right after
+    return TMP_READY;
+}
+
+/*
+ *@brief Triggers a one-shot on every sensor of the array, back to back, and returns at once. The conversions
+ *       run in parallel, TEMP_ArrayTickHandler marks the array ready when the last one is over.
+ *       A sensor that does not take the trigger is left out and reads as TEMP_CENTI_INVALID.
+ *       With a burst set the following conversions are triggered by TEMP_ArrayFetch.
+ *@param array pointer
+ *@retval TEMP Status, TMP_ERROR if no sensor started, TMP_BUSY while the last conversions run
+ * */
+TEMP_STATUS TEMP_ArrayStart(TEMP_Array *array)
+{
+    if(array->period != 0){
+    	return TMP_ERROR;	// converting continuously
+    }
+    if(array->conv_state == TMP_CONV_RUNNING || array->burst_idx != 0){
+    	return TMP_BUSY;
+    }
+
+    for(uint8_t i = 0; i < array->count; i++){
+    	array->channels[i].burst_count = 0;
+    }
+    return TEMP_ArrayTrigger(array);
+}
+
+/*
+ *@brief Whether all conversions started by TEMP_ArrayStart are done
+ *@param array pointer
+ *@retval true if TEMP_ArrayFetch can read the results
+ * */
+bool TEMP_ArrayIsReady(TEMP_Array *array)
+{
+    return (array->conv_state == TMP_CONV_DONE);
+}
+
+/*
+ *@brief Reads the results of all sensors, one register read each. Inside a burst every sensor is
+ *       triggered again right after its result is read, TMP_BUSY is returned until the last conversion
+ *       of the burst is read and filtered. In continuous mode TMP_BUSY is returned until the last read
+ *       of the decimation, see TEMP_ArraySetContinuous.
+ *@param[1] array pointer
+ *@param[2] centi used to return one value per sensor in 0.01 °C, TEMP_CENTI_INVALID for a missing one
+ *@retval TEMP Status, TMP_ERROR if a channel is invalid (the others are still returned), TMP_BUSY while running
+ * */
+TEMP_STATUS TEMP_ArrayFetch(TEMP_Array *array, int16_t *centi)
+{
+    if(array->conv_state == TMP_CONV_RUNNING){
+    	return TMP_BUSY;
+    }
+    if(array->conv_state != TMP_CONV_DONE){
+    	return TMP_ERROR;	// no conversion started
+    }
+    if(array->period != 0){
+    	return TEMP_ArrayDecimate(array, centi);
+    }
+
+    bool more = (++array->burst_idx < array->burst);	// first, TEMP_ArrayStart is refused from here on
+    uint16_t started = 0;
+    for(uint8_t i = 0; i < array->count; i++){
+    	TEMP_Channel *channel = &array->channels[i];
+    	if(!(array->started & (1u << i))){
+    		continue;
+    	}
+    	if(TEMP_FetchRaw(channel->sensor.hi2c, &channel->sensor, &channel->burst_raw[channel->burst_count]) == TMP_READY){
+    		channel->burst_count++;
+    	}
+    	if(more && TEMP_StartOneShot(channel->sensor.hi2c, &channel->sensor) == TMP_READY){
+    		started |= (uint16_t)(1u << i);
+    	}
+    }
+    if(started != 0){
+    	array->started = started;
+    	array->conv_state = TMP_CONV_RUNNING;
+    	return TMP_BUSY;
+    }
+
+    TEMP_STATUS status = TMP_READY;
+    for(uint8_t i = 0; i < array->count; i++){
+    	TEMP_Channel *channel = &array->channels[i];
+    	if(channel->burst_count == 0){
+    		centi[i] = TEMP_CENTI_INVALID;
+    		status = TMP_ERROR;
+    	}
+    	else{
+    		centi[i] = TEMP_Filter(channel->burst_raw, channel->burst_count, array->filter);
+    	}
+    	channel->burst_count = 0;
+    }
+    array->conv_state = TMP_CONV_IDLE;
+    array->burst_idx = 0;	// last, TEMP_ArrayStart may run right after
+    return status;
+}
+
+/*
+ *@brief To be called from HAL_SYSTICK_Callback instead of the TickHandler of the single sensors
+ *@param array pointer
+ *@retval void
+ * */
+void TEMP_ArrayTickHandler(TEMP_Array *array)
+{
+    if(array->period != 0){
+    	// the sensors convert on their own, only the read slots are timed
+    	if((HAL_GetTick() - array->period_tick) >= array->period){
+    		array->period_tick += array->period;
+    		if(array->conv_state == TMP_CONV_RUNNING){
+    			array->conv_state = TMP_CONV_DONE;
+    			TEMP_ArrayCpltCallback(array);
+    		}
+    	}
+    	return;
+    }
+    if(array->conv_state != TMP_CONV_RUNNING){
+    	return;
+    }
+
+    bool done = true;
+    for(uint8_t i = 0; i < array->count; i++){
+    	if(array->started & (1u << i)){
+    		TEMP_TickHandler(&array->channels[i].sensor);
+    		done &= (array->channels[i].sensor.conv_state != TMP_CONV_RUNNING);
+    	}
+    }
+    if(done){
+    	array->conv_state = TMP_CONV_DONE;
+    	TEMP_ArrayCpltCallback(array);
+    }
+}
+
+/*
+ *@brief Time until TEMP_ArrayTickHandler has something to do, the SysTick may be left out that long
+ *@param array pointer
+ *@retval ms until the next read slot or the end of the last conversion, 0 if due, UINT32_MAX if none runs
+ * */
+uint32_t TEMP_ArrayIdleMs(TEMP_Array *array)
+{
+    if(array->period != 0){
+    	uint32_t elapsed = HAL_GetTick() - array->period_tick;
+    	return (elapsed >= array->period) ? 0 : array->period - elapsed;
+    }
+    if(array->conv_state != TMP_CONV_RUNNING){
+    	return UINT32_MAX;
+    }
+
+    uint32_t idle = UINT32_MAX;
+    for(uint8_t i = 0; i < array->count; i++){
+    	if(array->started & (1u << i)){
+    		uint32_t ms = TEMP_IdleMs(&array->channels[i].sensor);
+    		if(ms < idle){
+    			idle = ms;
+    		}
+    	}
+    }
+    return idle;
+}
+
+/*
+ *@brief Called from the SysTick interrupt once all results of the array are ready, override in the application
+ *@param array pointer
+ *@retval void
+ * */
+__weak void TEMP_ArrayCpltCallback(TEMP_Array *array)
+{
+    (void)array;
+}
+
+/*
+ *@brief Static function to trigger a one-shot on every sensor of the array
+ *@param array pointer
+ *@retval TEMP Status, TMP_ERROR if no sensor started
+ * */
+static TEMP_STATUS TEMP_ArrayTrigger(TEMP_Array *array)
+{
+    uint16_t started = 0;
+    for(uint8_t i = 0; i < array->count; i++){
+    	TEMP_Channel *channel = &array->channels[i];
+    	if(TEMP_StartOneShot(channel->sensor.hi2c, &channel->sensor) == TMP_READY){
+    		started |= (uint16_t)(1u << i);
+    	}
+    }
+    if(started == 0){
+    	array->conv_state = TMP_CONV_IDLE;
+    	return TMP_ERROR;
+    }
+
+    array->started = started;
+    array->conv_state = TMP_CONV_RUNNING;  // last, the tick handler may run right after
+    return TMP_READY;
+}
+
+/*
+ *@brief Static function to take one read of every continuously converting sensor into the decimation
+ *@param[1] array pointer
+ *@param[2] centi used to return one value per sensor in 0.01 °C after the last read of the decimation
+ *@retval TEMP Status, TMP_ERROR if a channel is invalid, TMP_BUSY until the last read
+ * */
+static TEMP_STATUS TEMP_ArrayDecimate(TEMP_Array *array, int16_t *centi)
+{
+    array->conv_state = TMP_CONV_RUNNING;	// first, waits for the next read slot
+    for(uint8_t i = 0; i < array->count; i++){
+    	TEMP_Channel *channel = &array->channels[i];
+    	int16_t raw;
+    	if((array->started & (1u << i)) && TEMP_ReadRaw(channel->sensor.hi2c, &channel->sensor, &raw) == TMP_READY){
+    		channel->decim_sum += raw;
+    		channel->decim_count++;
+    	}
+    }
+    if(++array->decim_idx < array->decim){
+    	return TMP_BUSY;
+    }
+
+    TEMP_STATUS status = TMP_READY;
+    for(uint8_t i = 0; i < array->count; i++){
+    	TEMP_Channel *channel = &array->channels[i];
+    	if(channel->decim_count == 0){
+    		centi[i] = TEMP_CENTI_INVALID;
+    		status = TMP_ERROR;
+    	}
+    	else{
+    		centi[i] = TEMP_RawMean(channel->decim_sum, channel->decim_count);
+    	}
+    	channel->decim_sum = 0;
+    	channel->decim_count = 0;
+    }
+    array->decim_idx = 0;
+    return status;
+}
+
+/*
+ *@brief Static function to reduce the results of a burst, integer only. A single result is
+ *       converted the same way as by the ReadTemperature of the driver.
+ *@param[1] raw results, sorted in place
+ *@param[2] number of results, at least 1
+ *@param[3] reduction
+ *@retval value in 0.01 °C
+ * */
+static int16_t TEMP_Filter(int16_t *raw, uint8_t count, TEMP_FILTER filter)
+{
+    // insertion sort, a burst has 8 results at most
+    for(uint8_t i = 1; i < count; i++){
+    	int16_t value = raw[i];
+    	uint8_t j = i;
+    	while(j > 0 && raw[j - 1] > value){
+    		raw[j] = raw[j - 1];
+    		j--;
+    	}
+    	raw[j] = value;
+    }
+
+    // median: the middle one or two, trimmed mean: all but the lowest and the highest quarter
+    uint8_t first = (filter == TMP_FILTER_MEDIAN) ? (count - 1) / 2 : count / 4;
+    uint8_t last = (filter == TMP_FILTER_MEDIAN) ? count / 2 : count - 1 - count / 4;
+
+    int32_t sum = 0;
+    for(uint8_t i = first; i <= last; i++){
+    	sum += raw[i];
+    }
+    // mean of the raw steps to 0.01 °C, the fraction below one step is kept
+    return (int16_t)((sum * 100) / (TEMP_RAW_PER_DEGREE * (int32_t)(last - first + 1)));
+}
+
+/*
+ *@brief Static function to convert a sum of raw results to their mean in 0.01 °C, truncated like
+ *       TEMP_Filter. Split in quotient and remainder so a long decimation cannot overflow the sum x 100.
+ *@param[1] sum of the raw results
+ *@param[2] number of results, at least 1
+ *@retval value in 0.01 °C
+ * */
+static int16_t TEMP_RawMean(int32_t sum, uint16_t count)
+{
+    int32_t mean = sum / count;
+    int32_t rest = sum % count;
+    return (int16_t)((mean * 100 + (rest * 100) / count) / TEMP_RAW_PER_DEGREE);
+}
@@ -0,0 +1,97 @@
+/*
+ * temp_sensor.h
+ *
+ *  Sensor interface of the logger. The driver is picked by TEMP_SENSOR in temp_sensor_conf.h and every
+ *  TEMP_ call is a macro onto it, so there is no function pointer in the ISR path.
+ *
+ *  A driver provides, with its own prefix:
+ *    X_Handle with the members hi2c and conv_state (TEMP_CONV_STATE)
+ *    X_InitAddr, X_StartOneShot, X_IsResultReady, X_FetchResult, X_FetchRaw, X_ReadRaw, X_ReadTemperature,
+ *    X_SetContinuous, X_TickHandler, X_IdleMs with the TMP100 signatures, and X_I2C_ADDR_N(n), X_RAW_PER_DEGREE
+ *  Parts without a one-shot (LM75) leave shutdown on X_StartOneShot and go back into it on X_FetchRaw.
+ */
+
+#ifndef TEMPSENSOR_TEMP_SENSOR_H_
+#define TEMPSENSOR_TEMP_SENSOR_H_
+
+#include "temp_sensor_conf.h"
+
+#if (TEMP_SENSOR == TEMP_SENSOR_TMP100) || (TEMP_SENSOR == TEMP_SENSOR_TMP102)
+#include "tmp100.h"
+#define TEMP_DRIVER(fn)					TMP100_##fn
+typedef TMP100_Handle TEMP_Handle;
+#define TEMP_I2C_ADDR_N(n)				TMP100_I2C_ADDR_N(n)
+#define TEMP_RAW_PER_DEGREE				TMP100_RAW_PER_DEGREE
+#elif (TEMP_SENSOR == TEMP_SENSOR_TMP117)
+#include "tmp117.h"
+#define TEMP_DRIVER(fn)					TMP117_##fn
+typedef TMP117_Handle TEMP_Handle;
+#define TEMP_I2C_ADDR_N(n)				TMP117_I2C_ADDR_N(n)
+#define TEMP_RAW_PER_DEGREE				TMP117_RAW_PER_DEGREE
+#elif (TEMP_SENSOR == TEMP_SENSOR_LM75)
+#include "lm75.h"
+#define TEMP_DRIVER(fn)					LM75_##fn
+typedef LM75_Handle TEMP_Handle;
+#define TEMP_I2C_ADDR_N(n)				LM75_I2C_ADDR_N(n)
+#define TEMP_RAW_PER_DEGREE				LM75_RAW_PER_DEGREE
+#else
+#error "TEMP_SENSOR: unknown sensor part"
+#endif
+
+// Single sensor, resolved at compile time
+#define TEMP_InitAddr(hi2c, handle, addr)			TEMP_DRIVER(InitAddr)(hi2c, handle, addr)
+#define TEMP_StartOneShot(hi2c, handle)				TEMP_DRIVER(StartOneShot)(hi2c, handle)
+#define TEMP_IsResultReady(handle)					TEMP_DRIVER(IsResultReady)(handle)
+#define TEMP_FetchResult(hi2c, handle, centi)		TEMP_DRIVER(FetchResult)(hi2c, handle, centi)
+#define TEMP_FetchRaw(hi2c, handle, raw)			TEMP_DRIVER(FetchRaw)(hi2c, handle, raw)
+#define TEMP_ReadRaw(hi2c, handle, raw)				TEMP_DRIVER(ReadRaw)(hi2c, handle, raw)
+#define TEMP_ReadTemperature(hi2c, handle, centi)	TEMP_DRIVER(ReadTemperature)(hi2c, handle, centi)
+#define TEMP_SetContinuous(hi2c, handle, on)		TEMP_DRIVER(SetContinuous)(hi2c, handle, on)
+#define TEMP_TickHandler(handle)					TEMP_DRIVER(TickHandler)(handle)
+#define TEMP_IdleMs(handle)							TEMP_DRIVER(IdleMs)(handle)
+
+#define TEMP_ARRAY_MAX					16		// Sensors per array, 8 addresses on each of two buses
+#define TEMP_BURST_MAX					8		// Conversions per array result at most
+#define TEMP_CENTI_INVALID				INT16_MIN	// Channel of an array that gave no result
+
+// Reduction of an array burst to one value per sensor, integer math on the raw results
+typedef enum{
+	TMP_FILTER_MEDIAN = 0,			// Middle value, the mean of the middle two for an even burst
+	TMP_FILTER_TRIMMED_MEAN			// Mean without the lowest and the highest quarter
+}TEMP_FILTER;
+
+// One sensor of an array
+typedef struct{
+	TEMP_Handle sensor;							// Set up with TEMP_InitAddr, on any bus
+	int16_t burst_raw[TEMP_BURST_MAX];			// Results of the running burst, raw
+	uint8_t burst_count;						// Valid entries in burst_raw
+	int32_t decim_sum;							// Continuous mode: raw reads of the running result, summed
+	uint16_t decim_count;						// Valid reads in decim_sum
+}TEMP_Channel;
+
+// Sensors sampled together: all one-shots are triggered back to back and collected after one conversion time
+typedef struct{
+	TEMP_Channel *channels;
+	uint8_t count;								// Up to TEMP_ARRAY_MAX
+	uint16_t started;							// Bit per channel triggered for the running conversion, or converting continuously
+	uint8_t burst;								// Conversions per result, 0 or 1 for a single one
+	uint8_t burst_idx;							// Conversions of the running burst read so far
+	TEMP_FILTER filter;
+	uint16_t period;							// Continuous mode: ms between reads, 0 for one-shots
+	uint16_t decim;								// Continuous mode: reads per result
+	uint16_t decim_idx;							// Reads of the running result so far
+	uint32_t period_tick;						// HAL tick of the last read slot
+	volatile TEMP_CONV_STATE conv_state;		// Changed from the SysTick interrupt
+}TEMP_Array;
+
+//Sensor array, N sensors cost one conversion time
+TEMP_STATUS TEMP_ArraySetBurst(TEMP_Array *array, uint8_t count, TEMP_FILTER filter);
+TEMP_STATUS TEMP_ArraySetContinuous(TEMP_Array *array, uint16_t period, uint16_t decim);
+TEMP_STATUS TEMP_ArrayStart(TEMP_Array *array);
+bool TEMP_ArrayIsReady(TEMP_Array *array);
+TEMP_STATUS TEMP_ArrayFetch(TEMP_Array *array, int16_t *centi);
+void TEMP_ArrayTickHandler(TEMP_Array *array);
+uint32_t TEMP_ArrayIdleMs(TEMP_Array *array);
+void TEMP_ArrayCpltCallback(TEMP_Array *array);
+
+#endif /* TEMPSENSOR_TEMP_SENSOR_H_ */
@@ -0,0 +1,33 @@
+/*
+ * temp_sensor_conf.h
+ *
+ *  Sensor part of the logger, selected at compile time, and the types all sensor drivers share
+ */
+
+#ifndef TEMPSENSOR_TEMP_SENSOR_CONF_H_
+#define TEMPSENSOR_TEMP_SENSOR_CONF_H_
+
+#define TEMP_SENSOR_TMP100				1		// TMP100/TMP101, 9 to 12 bit
+#define TEMP_SENSOR_TMP102				2		// 12 bit, built from the TMP100 driver
+#define TEMP_SENSOR_TMP117				3		// 16 bit, ±0.1 °C
+#define TEMP_SENSOR_LM75				4		// LM75A/LM75B class, 11 bit
+
+#ifndef TEMP_SENSOR
+#define TEMP_SENSOR						TEMP_SENSOR_TMP100	// or -DTEMP_SENSOR=TEMP_SENSOR_TMP117 for a site build
+#endif
+
+typedef enum{
+	TMP_READY = 0,
+	TMP_ERROR = 1,
+	TMP_TIMEOUT,
+	TMP_BUSY						// One-shot conversion still running
+}TEMP_STATUS;
+
+// One-shot conversion, driven by the TickHandler of the driver
+typedef enum{
+	TMP_CONV_IDLE = 0,
+	TMP_CONV_RUNNING,				// Triggered, result not valid before the conversion time
+	TMP_CONV_DONE					// Result can be fetched
+}TEMP_CONV_STATE;
+
+#endif /* TEMPSENSOR_TEMP_SENSOR_CONF_H_ */